@@ -27,6 +27,9 @@ extern "C" {
 #define CPUID_FEATURE_MCE               BITFLAG(7)  // Machine-check Exceptions
 #define CPUID_FEATURE_APIC              BITFLAG(9)  // Advanced PIC
 #define CPUID_FEATURE_SYSENTER_SYSEXIT  BITFLAG(11) // SYSENTER and SYSEXIT
+#define CPUID_FEATURE_FXSR              BITFLAG(24) // FXSAVE and FXRSTOR
+#define CPUID_FEATURE_SSE               BITFLAG(25) // SSE
+#define CPUID_FEATURE_SSE2              BITFLAG(26) // SSE2
 
 
 // Result fields of CPUID
@@ -38,7 +41,7 @@ struct cpuid_result
     u32 d;
 };
 
-INLINE struct cpuid_result cpuid(u32 query)
+static ALWAYS_INLINE struct cpuid_result cpuid(u32 query)
 {
     struct cpuid_result result;
     ASM(
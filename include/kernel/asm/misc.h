@@ -4,6 +4,7 @@
 #include <kernel/kernel.h>
 #include <kernel/types.h>
 #include <kernel/compiler.h>
+#include <kernel/irqtrace.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,12 +13,18 @@ extern "C" {
 // Disable interrupts
 static ALWAYS_INLINE void cli(void)
 {
+#if IRQ_TRACE
+    irqtrace_irqs_disabling();
+#endif
     ASM("cli");
 }
 
 // Enable interrupts
 static ALWAYS_INLINE void sti(void)
 {
+#if IRQ_TRACE
+    irqtrace_irqs_enabling();
+#endif
     ASM("sti");
 }
 
@@ -27,6 +34,12 @@ static ALWAYS_INLINE void hlt(void)
     ASM("hlt");
 }
 
+// Stops the compiler from moving memory accesses across this point
+static ALWAYS_INLINE void barrier(void)
+{
+    ASM_VOLATILE("" ::: "memory");
+}
+
 // Get clock-cycles since boot via RDTSC (Read Time-stamp counter)
 static ALWAYS_INLINE u64 rdtsc(void)
 {
@@ -38,6 +51,31 @@ static ALWAYS_INLINE u64 rdtsc(void)
     return value;
 }
 
+// 64 by 32-bit unsigned division. There is no libgcc to provide __udivdi3,
+// so 64-bit dividends go through this instead of the / operator.
+static ALWAYS_INLINE u64 div_u64_u32(u64 dividend, u32 divisor, u32 *remainder)
+{
+    u32 high = (u32) (dividend >> 32);
+    u32 q_high = high / divisor;
+    u32 q_low;
+    u32 rem = high % divisor;
+
+    // rem < divisor, so the quotient of rem:low fits in 32 bits
+    ASM(
+        "div %2":
+        "=a"(q_low),
+        "=d"(rem):
+        "r"(divisor),
+        "a"((u32) dividend),
+        "d"(rem)
+    );
+
+    if (remainder) {
+        *remainder = rem;
+    }
+    return ((u64) q_high << 32) | q_low;
+}
+
 // Write model-specific register
 static ALWAYS_INLINE void wrmsr(u32 reg, u64 value)
 {
@@ -60,6 +98,105 @@ static ALWAYS_INLINE u64 rdmsr(u32 reg)
     return value;
 }
 
+// EFLAGS flags
+#define EFLAGS_IF       BITFLAG(9)  // Interrupts enabled
+
+// Control register flags
+#define CR0_MP          BITFLAG(1)  // Monitor co-processor (WAIT obeys TS)
+#define CR0_EM          BITFLAG(2)  // x87 emulation (FPU instructions trap)
+#define CR0_TS          BITFLAG(3)  // Task switched (FPU use traps to #NM)
+#define CR0_NE          BITFLAG(5)  // Native (#MF) x87 error reporting
+#define CR0_WP          BITFLAG(16) // Ring 0 writes obey read-only pages
+#define CR0_PG          BITFLAG(31) // Paging enabled
+#define CR4_OSFXSR      BITFLAG(9)  // OS supports FXSAVE/FXRSTOR and SSE
+#define CR4_OSXMMEXCPT  BITFLAG(10) // OS handles #XM SIMD exceptions
+
+static ALWAYS_INLINE u32 read_cr0(void)
+{
+    u32 value;
+    ASM_VOLATILE(
+        "mov %0, cr0":
+        "=r"(value)
+    );
+    return value;
+}
+
+static ALWAYS_INLINE void write_cr0(u32 value)
+{
+    ASM_VOLATILE(
+        "mov cr0, %0"::
+        "r"(value):
+        "memory"
+    );
+}
+
+// Read the page-fault linear address register
+static ALWAYS_INLINE u32 read_cr2(void)
+{
+    u32 value;
+    ASM_VOLATILE(
+        "mov %0, cr2":
+        "=r"(value)
+    );
+    return value;
+}
+
+// Page directory base register
+static ALWAYS_INLINE u32 read_cr3(void)
+{
+    u32 value;
+    ASM_VOLATILE(
+        "mov %0, cr3":
+        "=r"(value)
+    );
+    return value;
+}
+
+// Switches page directory, flushing all non-global TLB entries
+static ALWAYS_INLINE void write_cr3(u32 value)
+{
+    ASM_VOLATILE(
+        "mov cr3, %0"::
+        "r"(value):
+        "memory"
+    );
+}
+
+// Flush the TLB entry for one page
+static ALWAYS_INLINE void invlpg(u32 addr)
+{
+    ASM_VOLATILE(
+        "invlpg [%0]"::
+        "r"(addr):
+        "memory"
+    );
+}
+
+static ALWAYS_INLINE u32 read_cr4(void)
+{
+    u32 value;
+    ASM_VOLATILE(
+        "mov %0, cr4":
+        "=r"(value)
+    );
+    return value;
+}
+
+static ALWAYS_INLINE void write_cr4(u32 value)
+{
+    ASM_VOLATILE(
+        "mov cr4, %0"::
+        "r"(value):
+        "memory"
+    );
+}
+
+// Clear CR0.TS
+static ALWAYS_INLINE void clts(void)
+{
+    ASM_VOLATILE("clts");
+}
+
 static ALWAYS_INLINE void ud2(void)
 {
     ASM_VOLATILE("ud2");
@@ -25,6 +25,7 @@
     #define ASM_VOLATILE    __asm__ volatile
     #define ASM_GOTO        __asm__ goto
     #define NO_REMOVE       __attribute__((__used__))
+    #define SECTION(S)      __attribute__((__section__(S)))
 #else
     #define INLINE
     #define ALWAYS_INLINE
@@ -41,6 +42,7 @@
     #define ASM_VOLATILE
     #define ASM_GOTO
     #define NO_REMOVE
+    #define SECTION(S)
 #endif
 
 #endif /* _INC_KERNEL_COMPILER */
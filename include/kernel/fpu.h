@@ -0,0 +1,31 @@
+#ifndef _INC_KERNEL_FPU
+#define _INC_KERNEL_FPU 1
+
+#include <kernel/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel-mode SIMD sections.
+//
+// Kernel code must not touch x87/MMX/SSE registers outside of a
+// kernel_fpu_begin()/kernel_fpu_end() pair. Beginning a section saves the
+// registers of whichever context currently owns the FPU; ending it makes that
+// context reload them lazily on its next FPU use.
+//
+// There is no preemptive scheduler - only interrupts can preempt kernel code
+// - so a section runs with interrupts disabled. Keep sections short. Sections
+// nest, and may be used from interrupt handlers.
+
+// Returns true if the FPU is initialised and SSE2 is available.
+bool kernel_fpu_usable(void);
+
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_FPU */
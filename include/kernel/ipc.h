@@ -0,0 +1,48 @@
+#ifndef _INC_KERNEL_IPC
+#define _INC_KERNEL_IPC 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Synchronous message passing between processes.
+//
+// An endpoint is created by the process that serves it. Clients make calls
+// to it: SYS_IPC_CALL sends one word and blocks until the server replies
+// with one word, both passed in registers. The server takes calls one at a
+// time with SYS_IPC_RECV and answers each with SYS_IPC_REPLY.
+//
+// Large payloads are not copied. A call may grant whole pages: they are
+// unmapped from the client and mapped into the window the server gave to
+// SYS_IPC_RECV. The reply may grant pages back, which are mapped where the
+// client's pages were. A server that passes no window refuses grants; the
+// pages then stay with the client.
+//
+// Failed calls return -KERROR_* values, so reply words in that range can't
+// be told apart from errors.
+
+// Largest grant, in pages
+#define IPC_MAX_GRANT_PAGES     16
+
+// Describes a grant of 'pages' pages starting at page-aligned address 'va',
+// for the grant argument of SYS_IPC_CALL and SYS_IPC_REPLY. 0 grants nothing.
+#define IPC_GRANT(va, pages)    ((u32) (va) | (u32) (pages))
+#define IPC_GRANT_ADDR(grant)   ((grant) & ~(PAGE_SIZE - 1))
+#define IPC_GRANT_PAGES(grant)  ((grant) & (PAGE_SIZE - 1))
+
+// Filled in by SYS_IPC_RECV
+struct ipc_message {
+    u32 word;               // From the caller
+    u32 pages;              // Pages mapped into the window
+    s32 sender;             // Caller's process id
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_IPC */
@@ -0,0 +1,39 @@
+#ifndef _INC_KERNEL_IRQTRACE
+#define _INC_KERNEL_IRQTRACE 1
+
+#include <kernel/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Interrupt latency tracing. When built with IRQ_TRACE=1, the common ISR path
+// records a per-vector histogram of handler durations, and cli()/sti() track
+// the longest section run with interrupts disabled. When IRQ_TRACE is 0 the
+// hooks are compiled out entirely and only irqtrace_dump() remains.
+
+#ifndef IRQ_TRACE
+#define IRQ_TRACE 0
+#endif
+
+// Histogram buckets are powers of two of TSC cycles. Bucket 0 collects
+// everything below 2^IRQTRACE_MIN_SHIFT, the last bucket everything above.
+#define IRQTRACE_MIN_SHIFT  6
+#define IRQTRACE_BUCKETS    16
+
+#if IRQ_TRACE
+// Called by cli() and sti(), respectively, from the call site of those.
+void irqtrace_irqs_disabling(void);
+void irqtrace_irqs_enabling(void);
+
+// Called by the ISR dispatcher around each handler.
+void irqtrace_isr_exit(u32 vector, u64 start_tsc);
+#endif
+
+void irqtrace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_IRQTRACE */
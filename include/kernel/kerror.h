@@ -21,6 +21,8 @@ enum {
     KERROR_ARG_INVALID,
     KERROR_HARDWARE_PORT,
     KERROR_LIMIT_EXCEEDED,
+    KERROR_BAD_ADDRESS,
+    KERROR_NOT_IMPLEMENTED,
 
     // Must always be last
     KERROR_LAST,
@@ -1,11 +1,123 @@
 #ifndef _INC_KERNEL_KLOG
 #define _INC_KERNEL_KLOG 1
 
+#include <kernel/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int klog_printf(const char *format, ...);
+// Kernel log.
+//
+// klog_err() and friends only format the message into a ring of fixed-size
+// records, stamped with a sequence number and the time since boot. They take
+// no locks and never touch a device, so they are safe from any context,
+// including interrupt handlers. The records are written out to the registered sinks
+// later, by klog_flush(), which the idle loop calls.
+//
+// If producers get more than KLOG_RECORDS ahead of the consumer, the oldest
+// records are overwritten and counted as dropped.
+
+// Records in the ring. Must be a power of two.
+#define KLOG_RECORDS        256
+
+// Longest message kept, including the terminator. Longer ones are cut short.
+#define KLOG_TEXT_SIZE      112
+
+// Most sinks at once
+#define KLOG_MAX_SINKS      4
+
+// Log levels, most severe first
+#define KLOG_LEVEL_ERR      0
+#define KLOG_LEVEL_WARN     1
+#define KLOG_LEVEL_INFO     2
+#define KLOG_LEVEL_DEBUG    3
+
+// Build-time threshold: klog_err() and friends for less severe levels
+// compile to nothing, format strings included. Set with 'make KLOG_LEVEL=n'.
+#ifndef KLOG_LEVEL
+#define KLOG_LEVEL          KLOG_LEVEL_INFO
+#endif
+
+// Subsystem tags. The tag's name prefixes each message, and can be masked off
+// at run time with klog_set_mask().
+enum klog_tag {
+    KLOG_KERNEL,        // No prefix
+    KLOG_CON,
+    KLOG_ELF,
+    KLOG_FPU,
+    KLOG_FRAME,
+    KLOG_GDT,
+    KLOG_IDT,
+    KLOG_IPC,
+    KLOG_IRQ,
+    KLOG_ISR,
+    KLOG_KB,
+    KLOG_MOUSE,
+    KLOG_PAGE,
+    KLOG_PIC,
+    KLOG_PROC,
+    KLOG_PS2,
+    KLOG_SERIAL,
+    KLOG_SYSCALL,
+    KLOG_URING,
+    KLOG_USERMODE,
+    KLOG_VDATA,
+    KLOG_VGA,
+    KLOG_VM,
+
+    KLOG_TAG_COUNT
+};
+
+#define KLOG_TAG_BIT(tag)   (1u << (tag))
+#define KLOG_ALL_TAGS       (KLOG_TAG_BIT(KLOG_TAG_COUNT) - 1)
+
+#if KLOG_LEVEL >= KLOG_LEVEL_ERR
+#define klog_err(tag, ...)      klog_log(KLOG_LEVEL_ERR, tag, __VA_ARGS__)
+#else
+#define klog_err(tag, ...)      do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_WARN
+#define klog_warn(tag, ...)     klog_log(KLOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define klog_warn(tag, ...)     do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_INFO
+#define klog_info(tag, ...)     klog_log(KLOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define klog_info(tag, ...)     do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_DEBUG
+#define klog_debug(tag, ...)    klog_log(KLOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define klog_debug(tag, ...)    do { } while (0)
+#endif
+
+// Flushed records are written to kio sinks (see kernel/kio.h)
+struct kio_sink;
+
+// Logs a message prefixed with the tag's name, unless the tag is masked off.
+// Errors are logged regardless of the mask. Use the klog_err() family rather
+// than calling this directly.
+int klog_log(int level, enum klog_tag tag, const char *format, ...);
+
+// Sets which tags are logged at levels other than error; a set of
+// KLOG_TAG_BIT()s. Every tag is enabled at boot.
+void klog_set_mask(u32 tags);
+u32 klog_get_mask(void);
+
+// Writes out every committed record. Does nothing if called while a flush
+// is already in progress, e.g. from an interrupt.
+void klog_flush(void);
+
+// Adds a sink for flushed records. The console is always a sink.
+int klog_add_sink(struct kio_sink *sink);
+
+// Number of records overwritten before they were flushed
+u32 klog_get_dropped(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,62 @@
+#ifndef _INC_KERNEL_KTRACE
+#define _INC_KERNEL_KTRACE 1
+
+#include <kernel/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary trace log for hot paths. ktrace_printf() doesn't format anything:
+// it stores the format string pointer, the TSC, the CPU and the raw argument
+// words in a per-CPU ring, which costs tens of cycles. The text is only
+// produced when the ring is dumped.
+//
+// Because formatting happens later:
+//  - arguments must be 32-bit values (ints, pointers; no 64-bit integers),
+//    and at most KTRACE_MAX_ARGS of them; more fails to build
+//  - %s arguments and the format string itself must still be valid at dump
+//    time, i.e. string literals
+//
+// When built with KTRACE=0, ktrace_printf() compiles to nothing.
+
+#ifndef KTRACE
+#define KTRACE 1
+#endif
+
+// Entries per CPU ring. Must be a power of two.
+#define KTRACE_ENTRIES      1024
+#define KTRACE_MAX_ARGS     4
+
+// Only the boot CPU runs for now, but the rings are kept per CPU so that
+// producers never share one.
+#define KTRACE_MAX_CPUS     1
+
+// Counts the arguments after the format string. Counts go past
+// KTRACE_MAX_ARGS so that ktrace_printf() can reject too many at build time.
+#define __KTRACE_NARGS(...) \
+    __KTRACE_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __KTRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+#if KTRACE
+#define ktrace_printf(format, ...) \
+    do { \
+        _Static_assert(__KTRACE_NARGS(__VA_ARGS__) <= KTRACE_MAX_ARGS, \
+            "too many ktrace_printf() arguments"); \
+        ktrace_log(format, __KTRACE_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    } while (0)
+#else
+#define ktrace_printf(format, ...) do { } while (0)
+#endif
+
+// Records an entry. Use ktrace_printf() rather than calling this directly.
+void ktrace_log(const char *format, u32 nargs, ...);
+
+// Formats and prints every entry still in the rings, oldest first.
+void ktrace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_KTRACE */
@@ -0,0 +1,150 @@
+#ifndef _INC_KERNEL_SYSCALL
+#define _INC_KERNEL_SYSCALL 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+#include <kernel/vdata.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// System call interface, shared by the kernel and user programs.
+
+#define SYSCALL_IDT_INDEX 0x40
+
+// System call ABI (int 0x40):
+//  EAX         - system call number (SYS_*)
+//  EBX/ECX/EDX - arguments 1 to 3
+//  EAX         - return value. Errors are returned as -KERROR_* values.
+// All other registers are preserved.
+//
+// On CPUs with SYSENTER/SYSEXIT, user mode can take the faster path through
+// the stub published in the kernel data page, with the same registers; see
+// syscall_fast4().
+
+// System call numbers
+enum {
+    SYS_NULL        = 0,    // () -> 0. Does nothing; measures entry cost
+    SYS_WRITE       = 1,    // (const char *buf, size_t len) -> len
+    SYS_GET_TICKS   = 2,    // () -> PIT ticks since boot
+    SYS_USER_RETURN = 3,    // (u32 result) -> does not return; ends usermode_call()
+    SYS_URING_SETUP = 4,    // (struct uring *ring, u32 entries) -> ring id
+    SYS_URING_ENTER = 5,    // (int id) -> submissions consumed
+    SYS_URING_DESTROY = 6,  // (int id) -> 0
+    SYS_EXIT        = 7,    // (int code) -> does not return
+    SYS_YIELD       = 8,    // () -> 0
+    SYS_GETPID      = 9,    // () -> process id
+    SYS_FORK        = 10,   // () -> child pid in the parent, 0 in the child
+    SYS_EXEC        = 11,   // (const char *name, size_t len) -> 0 in the new image
+    SYS_WAIT        = 12,   // (int pid, int *code) -> 0
+    SYS_IPC_CREATE  = 13,   // () -> endpoint id; see <kernel/ipc.h>
+    SYS_IPC_DESTROY = 14,   // (int id) -> 0
+    SYS_IPC_CALL    = 15,   // (int id, u32 word, u32 grant) -> reply word
+    SYS_IPC_RECV    = 16,   // (int id, struct ipc_message *msg, void *window) -> 0
+    SYS_IPC_REPLY   = 17,   // (int id, u32 word, u32 grant) -> 0
+
+    // Must always be last
+    SYSCALL_MAX     = 64,
+};
+
+static ALWAYS_INLINE u32 __syscall1(u32 num)
+{
+    u32 result;
+    ASM_VOLATILE(
+        "int %1":
+        "=a"(result):
+        "N"(SYSCALL_IDT_INDEX),
+        "a"(num):
+        "cc",
+        "memory"
+    );
+    return result;
+}
+
+static ALWAYS_INLINE u32 __syscall2(u32 num, u32 b)
+{
+    u32 result;
+    ASM_VOLATILE(
+        "int %1":
+        "=a"(result):
+        "N"(SYSCALL_IDT_INDEX),
+        "a"(num),
+        "b"(b):
+        "cc",
+        "memory"
+    );
+    return result;
+}
+
+static ALWAYS_INLINE u32 __syscall3(u32 num, u32 b, u32 c)
+{
+    u32 result;
+    ASM_VOLATILE(
+        "int %1":
+        "=a"(result):
+        "N"(SYSCALL_IDT_INDEX),
+        "a"(num),
+        "b"(b),
+        "c"(c):
+        "cc",
+        "memory"
+    );
+    return result;
+}
+
+static ALWAYS_INLINE u32 __syscall4(u32 num, u32 b, u32 c, u32 d)
+{
+    u32 result;
+    ASM_VOLATILE(
+        "int %1":
+        "=a"(result):
+        "N"(SYSCALL_IDT_INDEX),
+        "a"(num),
+        "b"(b),
+        "c"(c),
+        "d"(d):
+        "cc",
+        "memory"
+    );
+    return result;
+}
+
+// Calls the SYSENTER stub at 'stub' (see struct vdata) with the int 0x40
+// register ABI.
+static ALWAYS_INLINE u32 __sysenter4(u32 stub, u32 num, u32 b, u32 c, u32 d)
+{
+    u32 result;
+    ASM_VOLATILE(
+        "call %1":
+        "=a"(result):
+        "S"(stub),
+        "a"(num),
+        "b"(b),
+        "c"(c),
+        "d"(d):
+        "cc",
+        "memory"
+    );
+    return result;
+}
+
+// System call from user mode, through SYSENTER where available and int 0x40
+// otherwise. SYSEXIT always returns to ring 3, so kernel-mode callers must
+// use the __syscallN() wrappers.
+static ALWAYS_INLINE u32 syscall_fast4(u32 num, u32 b, u32 c, u32 d)
+{
+    u32 stub = VDATA_ADDR->sysenter_stub;
+
+    if (stub) {
+        return __sysenter4(stub, num, b, c, d);
+    }
+    return __syscall4(num, b, c, d);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_SYSCALL */
@@ -0,0 +1,75 @@
+#ifndef _INC_KERNEL_URING
+#define _INC_KERNEL_URING 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Asynchronous system call rings, shared between a caller and the kernel.
+//
+// The caller queues operations by filling in submission entries and
+// advancing sq_tail; the kernel consumes them in the background, advancing
+// sq_head, and posts one completion per operation at cq_tail. The caller
+// reaps completions from cq_head. Neither side traps per operation: the
+// kernel polls registered rings from the timer, and SYS_URING_ENTER only
+// asks it to drain right away.
+//
+// Memory layout, as one block of URING_SIZE(entries) bytes:
+//  struct uring                    - indices and sizes
+//  struct uring_sqe[entries]       - submission queue
+//  struct uring_cqe[entries]       - completion queue
+
+// Operations
+enum {
+    URING_OP_NOP    = 0,    // Completes with 0
+    URING_OP_WRITE  = 1,    // Write addr[0..len) to the console -> bytes
+                            // written, which may be fewer than len
+    URING_OP_READ   = 2,    // Read len bytes at disk offset into addr
+    URING_OP_SLEEP  = 3,    // Complete after len milliseconds -> 0
+
+    URING_OP_MAX,
+};
+
+struct uring_sqe {
+    u8  opcode;             // URING_OP_*
+    u8  reserved[3];
+    u32 addr;
+    u32 len;
+    u32 offset;
+    u32 user_data;          // Copied into the completion
+};
+
+struct uring_cqe {
+    u32 user_data;
+    s32 result;             // As for the matching system call
+};
+
+struct uring {
+    // Free-running indices; an entry's slot is index & (entries - 1).
+    volatile u32    sq_head;        // Written by the kernel
+    volatile u32    sq_tail;        // Written by the caller
+    volatile u32    cq_head;        // Written by the caller
+    volatile u32    cq_tail;        // Written by the kernel
+
+    // Power of two, for both queues. Set by the kernel at setup for the
+    // caller's information; the kernel keeps its own copy.
+    u32             entries;
+    volatile u32    overflow;       // Completions lost to a full queue
+};
+
+#define URING_SQES(RING)        ((struct uring_sqe *) ((RING) + 1))
+#define URING_CQES(RING)        ((struct uring_cqe *) \
+                                    (URING_SQES(RING) + (RING)->entries))
+#define URING_SIZE(ENTRIES)     (sizeof(struct uring) + \
+                                    (ENTRIES) * sizeof(struct uring_sqe) + \
+                                    (ENTRIES) * sizeof(struct uring_cqe))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_URING */
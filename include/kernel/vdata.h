@@ -0,0 +1,99 @@
+#ifndef _INC_KERNEL_VDATA
+#define _INC_KERNEL_VDATA 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+#include <kernel/asm/misc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel data page, mapped read-only at the same address in every address
+// space - the last page of user space. The kernel updates it from the timer
+// interrupt so that reading the time needs no system call.
+#define VDATA_ADDR          ((const struct vdata *) 0xbffff000)
+
+// Fixed-point shift of vdata.tsc_mult
+#define VDATA_TSC_SHIFT     24
+
+// Readers must use vdata_read(): the kernel may update the page at any time.
+struct vdata {
+    // Seqlock sequence number. Odd while an update is in progress.
+    volatile u32    seq;
+
+    // Entry stub for SYSENTER system calls, or 0 if unavailable. Set once at
+    // boot, so it may be read without the seqlock.
+    u32             sysenter_stub;
+
+    u32             tick_hz;        // Timer ticks per second (rounded)
+    u32             tick_ns;        // Length of one tick in nanoseconds
+    u64             ticks;          // Monotonic timer ticks since boot
+
+    // TSC at the last tick, and the factor to convert TSC cycles into
+    // nanoseconds: ns = (cycles * tsc_mult) >> VDATA_TSC_SHIFT.
+    // tsc_mult is zero until the TSC has been calibrated.
+    u64             tick_tsc;
+    u32             tsc_mult;
+
+    // Wall-clock time at the last tick, in Unix seconds and nanoseconds.
+    // Counts from zero if the real-time clock could not be read.
+    u32             wall_nsec;
+    u64             wall_sec;
+};
+
+// Takes a consistent copy of a kernel data page mapped at 'page'.
+static INLINE void vdata_read_from(const volatile struct vdata *page,
+    struct vdata *snapshot)
+{
+    u32 seq;
+
+    do {
+        while ((seq = page->seq) & 1) {
+            // Update in progress; the writer is an interrupt handler, so
+            // this only spins if it interrupted us mid-read.
+        }
+        barrier();
+
+        snapshot->tick_hz = page->tick_hz;
+        snapshot->tick_ns = page->tick_ns;
+        snapshot->ticks = page->ticks;
+        snapshot->tick_tsc = page->tick_tsc;
+        snapshot->tsc_mult = page->tsc_mult;
+        snapshot->wall_nsec = page->wall_nsec;
+        snapshot->wall_sec = page->wall_sec;
+
+        barrier();
+    } while (page->seq != seq);
+
+    snapshot->seq = seq;
+}
+
+// Takes a consistent copy of the kernel data page.
+static INLINE void vdata_read(struct vdata *snapshot)
+{
+    vdata_read_from((const volatile struct vdata *) VDATA_ADDR, snapshot);
+}
+
+// Nanoseconds since boot, interpolated between ticks with the TSC.
+static INLINE u64 vdata_monotonic_ns(const struct vdata *snapshot)
+{
+    u64 ns = snapshot->ticks * snapshot->tick_ns;
+
+    if (snapshot->tsc_mult) {
+        u64 delta = rdtsc() - snapshot->tick_tsc;
+        u64 offset = (delta * snapshot->tsc_mult) >> VDATA_TSC_SHIFT;
+
+        // Never run past the next tick, so time can't go backwards
+        ns += MIN(offset, (u64) snapshot->tick_ns - 1);
+    }
+
+    return ns;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INC_KERNEL_VDATA */
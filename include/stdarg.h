@@ -9,6 +9,7 @@ typedef unsigned char *va_list;
 
 #define va_start(ap, v) ((ap) = (va_list) &(v) + _VA_SIZEOF(v))
 #define va_end(ap)      ((ap) = (va_list) 0)
+#define va_copy(dst, src) ((dst) = (src))
 #define va_arg(ap, t)   (*(t *) (((ap) += _VA_SIZEOF(t)) - _VA_SIZEOF(t)))
 
 #endif /* _INC_STDARG */
@@ -36,6 +36,10 @@ void *memset(void *ptr, int value, size_t len);
 char *strerror(int errnum);
 size_t strlen(const char *str);
 
+/* Non-standard: SSE2 variants, used above a size threshold when available */
+void *memcpy_sse2(void *dest, const void *src, size_t len);
+void *memset_sse2(void *ptr, int value, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
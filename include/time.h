@@ -25,7 +25,8 @@ struct tm
 typedef long long clock_t;
 typedef long long time_t;
 
-#define CLOCKS_PER_SEC  ((clock_t) 1) /* TODO */
+/* clock() counts nanoseconds since boot */
+#define CLOCKS_PER_SEC  ((clock_t) 1000000000)
 
 clock_t clock(void);
 double difftime(time_t end, time_t beginning);
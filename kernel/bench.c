@@ -0,0 +1,479 @@
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/fpu.h>
+#include <kernel/kerror.h>
+#include <kernel/klog.h>
+#include <kernel/ktrace.h>
+#include <kernel/asm/misc.h>
+
+#include "bench.h"
+#include "con.h"
+#include "kio.h"
+#include "vdata.h"
+#include "vga.h"
+#include "uring.h"
+#include "proc.h"
+#include "user_images.h"
+#include "cpu/syscall.h"
+#include "cpu/usermode.h"
+
+// Each measurement is the best of this many runs, to filter out interrupts
+#define BENCH_ROUNDS        8
+
+#define BENCH_BUFFER_SIZE   (64 * 1024)
+
+#define BENCH_SYSCALLS      1000
+#define BENCH_USER_STACK    1024
+
+#define BENCH_URING_ENTRIES 64
+
+#define BENCH_LOG_CALLS     64
+
+// Console output: this many lines of BENCH_CON_LINE, about 4KiB
+#define BENCH_CON_LINES     64
+#define BENCH_CON_LINE      "console throughput: the quick brown fox jumps over it\n"
+#define BENCH_CURSOR_MOVES  1000
+
+#define BENCH_ITOA_VALUES   256
+
+// A typical log line: several literal runs between a few conversions
+#define BENCH_PRINTF_CALLS  64
+#define BENCH_PRINTF_FORMAT "proc %d: switched to %s at %x, %u ticks left\n"
+
+struct bench_case {
+    const char  *name;
+    void        (*run)(void);
+};
+
+static u8 s_buffer_src[BENCH_BUFFER_SIZE] ALIGN(16);
+static u8 s_buffer_dst[BENCH_BUFFER_SIZE] ALIGN(16);
+
+static u8 s_uring_mem[URING_SIZE(BENCH_URING_ENTRIES)] ALIGN(16);
+
+static const size_t s_mem_sizes[] = { 256, 1024, 4096, 16384, 65536 };
+
+static INLINE u32 clamp_cycles(u64 cycles)
+{
+    return (cycles > 0xffffffffULL) ? 0xffffffff : (u32) cycles;
+}
+
+static u32 time_copy(void *(*fn)(void *, const void *, size_t), size_t len)
+{
+    u64 best = ~0ULL;
+
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        u64 start = rdtsc();
+        fn(s_buffer_dst, s_buffer_src, len);
+        best = MIN(best, rdtsc() - start);
+    }
+
+    return clamp_cycles(best);
+}
+
+static u32 time_set(void *(*fn)(void *, int, size_t), size_t len)
+{
+    u64 best = ~0ULL;
+
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        u64 start = rdtsc();
+        fn(s_buffer_dst, 0x5a, len);
+        best = MIN(best, rdtsc() - start);
+    }
+
+    return clamp_cycles(best);
+}
+
+// Bytes per 100 cycles, to avoid needing fractions
+static INLINE u32 throughput(size_t len, u32 cycles)
+{
+    return cycles ? (u32) (len * 100) / cycles : 0;
+}
+
+static void bench_memcpy(void)
+{
+    if (!kernel_fpu_usable()) {
+        kprintf("  sse2 unavailable, memcpy_sse2 uses the scalar path\n");
+    }
+
+    kprintf("  size: scalar vs sse2 cycles (bytes/100 cycles)\n");
+
+    for (size_t i = 0; i < ARRLEN(s_mem_sizes); ++i) {
+        size_t len = s_mem_sizes[i];
+        u32 scalar = time_copy(memcpy, len);
+        u32 sse2 = time_copy(memcpy_sse2, len);
+
+        kprintf("  %u: %u (%u) vs %u (%u)\n", len,
+            scalar, throughput(len, scalar), sse2, throughput(len, sse2));
+    }
+}
+
+static void bench_memset(void)
+{
+    kprintf("  size: scalar vs sse2 cycles (bytes/100 cycles)\n");
+
+    for (size_t i = 0; i < ARRLEN(s_mem_sizes); ++i) {
+        size_t len = s_mem_sizes[i];
+        u32 scalar = time_set(memset, len);
+        u32 sse2 = time_set(memset_sse2, len);
+
+        kprintf("  %u: %u (%u) vs %u (%u)\n", len,
+            scalar, throughput(len, scalar), sse2, throughput(len, sse2));
+    }
+}
+
+// Runs in ring 3, so it and its data live in the .user sections. Results
+// are raw u64s, as clamp_cycles() is not callable from there.
+static u64 s_int_cycles USER_DATA;
+static u64 s_sysenter_cycles USER_DATA;
+static u8 s_user_stack[BENCH_USER_STACK] USER_DATA ALIGN(16);
+
+// Times null system calls through both entry paths.
+static void USER_TEXT bench_syscall_user(void)
+{
+    u32 stub = VDATA_ADDR->sysenter_stub;
+    u64 best = ~0ULL;
+
+    for (int r = 0; r < BENCH_ROUNDS; ++r) {
+        u64 start = rdtsc();
+        for (int i = 0; i < BENCH_SYSCALLS; ++i) {
+            __syscall1(SYS_NULL);
+        }
+        best = MIN(best, rdtsc() - start);
+    }
+    s_int_cycles = best;
+
+    if (!stub) {
+        return;
+    }
+
+    best = ~0ULL;
+    for (int r = 0; r < BENCH_ROUNDS; ++r) {
+        u64 start = rdtsc();
+        for (int i = 0; i < BENCH_SYSCALLS; ++i) {
+            __sysenter4(stub, SYS_NULL, 0, 0, 0);
+        }
+        best = MIN(best, rdtsc() - start);
+    }
+    s_sysenter_cycles = best;
+}
+
+static void bench_syscall(void)
+{
+    s_int_cycles = 0;
+    s_sysenter_cycles = 0;
+
+    usermode_call(bench_syscall_user, s_user_stack + sizeof(s_user_stack));
+
+    kprintf("  null syscall from ring 3, cycles per call\n");
+    kprintf("  int 0x40: %u\n", clamp_cycles(s_int_cycles) / BENCH_SYSCALLS);
+
+    if (VDATA_ADDR->sysenter_stub) {
+        kprintf("  sysenter: %u\n",
+            clamp_cycles(s_sysenter_cycles) / BENCH_SYSCALLS);
+    } else {
+        kprintf("  sysenter: unsupported\n");
+    }
+}
+
+// One batch of no-ops through the ring, with a single kernel entry
+static void uring_batch(struct uring *ring, int id)
+{
+    struct uring_sqe *sqes = URING_SQES(ring);
+
+    // The PIT may have posted completions since the last batch
+    ring->cq_head = ring->cq_tail;
+
+    while (ring->sq_tail - ring->sq_head < ring->entries) {
+        struct uring_sqe *sqe = &sqes[ring->sq_tail & (ring->entries - 1)];
+        sqe->opcode = URING_OP_NOP;
+        sqe->user_data = ring->sq_tail;
+        ++ring->sq_tail;
+    }
+
+    __syscall2(SYS_URING_ENTER, (u32) id);
+    ring->cq_head = ring->cq_tail;
+}
+
+static void bench_uring(void)
+{
+    struct uring *ring = (struct uring *) s_uring_mem;
+    u64 best_ring = ~0ULL;
+    u64 best_syscall = ~0ULL;
+    u32 id;
+
+    id = __syscall3(SYS_URING_SETUP, (u32) ring, BENCH_URING_ENTRIES);
+    if ((s32) id < 0) {
+        kprintf("  uring_setup failed: %d\n", (s32) id);
+        return;
+    }
+
+    for (int r = 0; r < BENCH_ROUNDS; ++r) {
+        u64 start = rdtsc();
+        uring_batch(ring, (int) id);
+        best_ring = MIN(best_ring, rdtsc() - start);
+
+        start = rdtsc();
+        for (int i = 0; i < BENCH_URING_ENTRIES; ++i) {
+            __syscall1(SYS_NULL);
+        }
+        best_syscall = MIN(best_syscall, rdtsc() - start);
+    }
+
+    __syscall2(SYS_URING_DESTROY, id);
+
+    kprintf("  %d no-ops, cycles per op\n", BENCH_URING_ENTRIES);
+    kprintf("  int 0x40 each: %u\n",
+        clamp_cycles(best_syscall) / BENCH_URING_ENTRIES);
+    kprintf("  ring batch: %u (overflow %u)\n",
+        clamp_cycles(best_ring) / BENCH_URING_ENTRIES, ring->overflow);
+}
+
+// IPC is measured from ring 3 by a pair of processes; see user/ipcbench.c
+static void bench_ipc(void)
+{
+    const struct user_image *image = user_image_find("ipcbench");
+    int pid;
+    int result = KERROR_ARG_INVALID;
+
+    if (image) {
+        result = proc_exec(image->name, image->start, user_image_size(image),
+            &pid);
+    }
+    if (!result) {
+        result = proc_wait(pid, NULL);
+    }
+
+    if (result) {
+        kprintf("  ipcbench failed: %d\n", result);
+    }
+}
+
+// Per-call cost of a text log line versus a binary trace entry. klog_info()
+// itself isn't called so as not to flood the console; its cost is dominated
+// by the formatting into a record, which is what's timed.
+static void bench_log(void)
+{
+    char text[KLOG_TEXT_SIZE];
+    u64 best_text = ~0ULL;
+    u64 best_trace = ~0ULL;
+
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        u64 start = rdtsc();
+        for (int j = 0; j < BENCH_LOG_CALLS; ++j) {
+            ksnprintf(text, sizeof(text), "bench: %d %x %s\n", j, i, "log");
+        }
+        best_text = MIN(best_text, rdtsc() - start);
+
+        start = rdtsc();
+        for (int j = 0; j < BENCH_LOG_CALLS; ++j) {
+            ktrace_printf("bench: %d %x %s\n", j, i, "log");
+        }
+        best_trace = MIN(best_trace, rdtsc() - start);
+    }
+
+    kprintf("  text: %u cycles/call\n",
+        clamp_cycles(best_text) / BENCH_LOG_CALLS);
+    kprintf("  ktrace: %u cycles/call\n",
+        clamp_cycles(best_trace) / BENCH_LOG_CALLS);
+}
+
+// Characters per second, given the nanoseconds it took to write them
+static INLINE u32 chars_per_sec(u32 chars, u64 ns)
+{
+    u32 rem;
+    return ns ? (u32) div_u64_u32((u64) chars * 1000000000, (u32) ns, &rem) : 0;
+}
+
+// Console throughput, including the flush to video memory. The cursor used
+// to be moved after every character, so the cost of that is measured
+// separately and added back in for comparison.
+static void bench_console(void)
+{
+    u32 chars = BENCH_CON_LINES * (sizeof(BENCH_CON_LINE) - 1);
+    u16 cursor = vga_get_cursor_location();
+    u64 start;
+    u64 write_ns;
+    u64 cursor_ns;
+    u64 eager_ns;
+    u32 rem;
+
+    start = vdata_get_monotonic_ns();
+    for (int i = 0; i < BENCH_CON_LINES; ++i) {
+        con_write_str(BENCH_CON_LINE);
+    }
+    con_flush();
+    write_ns = vdata_get_monotonic_ns() - start;
+
+    start = vdata_get_monotonic_ns();
+    for (int i = 0; i < BENCH_CURSOR_MOVES; ++i) {
+        vga_set_cursor_location(cursor);
+    }
+    cursor_ns = vdata_get_monotonic_ns() - start;
+
+    // Per character, as it was
+    eager_ns = write_ns + div_u64_u32(cursor_ns * chars, BENCH_CURSOR_MOVES,
+        &rem);
+
+    kprintf("  %u chars in %u us\n", chars, (u32) write_ns / 1000);
+    kprintf("  lazy cursor: %u chars/s\n", chars_per_sec(chars, write_ns));
+    kprintf("  cursor per char: %u chars/s\n", chars_per_sec(chars, eager_ns));
+}
+
+// The integer conversions kio used before the lookup table ones, kept for
+// comparison: one division per decimal digit, and always eight hex digits.
+static size_t legacy_itoa10(int val, char *dst)
+{
+    int buf[10];
+    size_t i = 0;
+    size_t count;
+
+    if (val < 0) {
+        *(dst++) = '-';
+        val = -val;
+    }
+
+    do {
+        buf[i++] = val % 10;
+        val /= 10;
+    } while (val && i < ARRLEN(buf));
+
+    count = i;
+    while (i) {
+        *(dst++) = (char) ('0' + buf[--i]);
+    }
+    *dst = '\0';
+
+    return count;
+}
+
+static size_t legacy_itoa16(int val, char *dst)
+{
+    static const char HEX_DIGIT_CHARS[16] = "0123456789abcdef";
+    int buf[8];
+    size_t i = 0;
+
+    while (i < ARRLEN(buf)) {
+        buf[i++] = val & 0x0f;
+        val >>= 4;
+    }
+    while (i) {
+        *(dst++) = HEX_DIGIT_CHARS[buf[--i]];
+    }
+    *dst = '\0';
+
+    return 8;
+}
+
+// Cycles per conversion over a spread of magnitudes, from 1 to 10 digits
+static void bench_itoa(void)
+{
+    char buf[KIO_UTOA_SIZE];
+    u32 values[BENCH_ITOA_VALUES];
+    u64 best[5] = { ~0ULL, ~0ULL, ~0ULL, ~0ULL, ~0ULL };
+    u32 seed = 0x2545f491;
+
+    for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        values[i] = seed >> (i % 32);
+    }
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        u64 start = rdtsc();
+        for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+            legacy_itoa10((int) (values[i] >> 1), buf);
+        }
+        best[0] = MIN(best[0], rdtsc() - start);
+
+        start = rdtsc();
+        for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+            __utoa10(values[i] >> 1, buf);
+        }
+        best[1] = MIN(best[1], rdtsc() - start);
+
+        start = rdtsc();
+        for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+            legacy_itoa16((int) values[i], buf);
+        }
+        best[2] = MIN(best[2], rdtsc() - start);
+
+        start = rdtsc();
+        for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+            __utoa16(values[i], buf, 0);
+        }
+        best[3] = MIN(best[3], rdtsc() - start);
+
+        start = rdtsc();
+        for (int i = 0; i < BENCH_ITOA_VALUES; ++i) {
+            __utoa10(((u64) values[i] << 32) | values[i], buf);
+        }
+        best[4] = MIN(best[4], rdtsc() - start);
+    }
+
+    kprintf("  dec: legacy %u, lut %u\n",
+        clamp_cycles(best[0]) / BENCH_ITOA_VALUES,
+        clamp_cycles(best[1]) / BENCH_ITOA_VALUES);
+    kprintf("  hex: legacy %u, branchless %u\n",
+        clamp_cycles(best[2]) / BENCH_ITOA_VALUES,
+        clamp_cycles(best[3]) / BENCH_ITOA_VALUES);
+    kprintf("  dec 64-bit: %u\n", clamp_cycles(best[4]) / BENCH_ITOA_VALUES);
+}
+
+// Cycles per ksnprintf() with a cached format, against the same format
+// copied to the stack, which the cache always skips
+static void bench_printf(void)
+{
+    char fmt[sizeof(BENCH_PRINTF_FORMAT)];
+    char text[KLOG_TEXT_SIZE];
+    u64 best_cached = ~0ULL;
+    u64 best_parsed = ~0ULL;
+    u32 hits;
+    u32 misses;
+
+    memcpy(fmt, BENCH_PRINTF_FORMAT, sizeof(fmt));
+
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        u64 start = rdtsc();
+        for (int j = 0; j < BENCH_PRINTF_CALLS; ++j) {
+            ksnprintf(text, sizeof(text), BENCH_PRINTF_FORMAT, j, "idle",
+                (u32) text, i);
+        }
+        best_cached = MIN(best_cached, rdtsc() - start);
+
+        start = rdtsc();
+        for (int j = 0; j < BENCH_PRINTF_CALLS; ++j) {
+            ksnprintf(text, sizeof(text), fmt, j, "idle", (u32) text, i);
+        }
+        best_parsed = MIN(best_parsed, rdtsc() - start);
+    }
+
+    kio_get_fmtcache_stats(&hits, &misses);
+
+    kprintf("  cached: %u cycles/call\n",
+        clamp_cycles(best_cached) / BENCH_PRINTF_CALLS);
+    kprintf("  parsed: %u cycles/call\n",
+        clamp_cycles(best_parsed) / BENCH_PRINTF_CALLS);
+    kprintf("  cache: %u hits, %u misses\n", hits, misses);
+}
+
+static const struct bench_case s_benches[] = {
+    { "memcpy", bench_memcpy },
+    { "memset", bench_memset },
+    { "syscall", bench_syscall },
+    { "uring", bench_uring },
+    { "ipc", bench_ipc },
+    { "log", bench_log },
+    { "console", bench_console },
+    { "itoa", bench_itoa },
+    { "printf", bench_printf },
+};
+
+void bench_run_all(void)
+{
+    for (size_t i = 0; i < ARRLEN(s_benches); ++i) {
+        kprintf("bench: %s\n", s_benches[i].name);
+        s_benches[i].run();
+    }
+
+    kprintf("bench: done\n");
+}
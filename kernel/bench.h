@@ -0,0 +1,10 @@
+#ifndef _INC_BENCH
+#define _INC_BENCH 1
+
+// In-kernel microbenchmarks, timed with the TSC. Results are printed to the
+// console. Should be run from thread context rather than from an ISR, since
+// some benchmarks take a while and want interrupts enabled.
+
+void bench_run_all(void);
+
+#endif /* _INC_BENCH */
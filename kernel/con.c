@@ -1,4 +1,5 @@
 #include <ctype.h>
+#include <string.h>
 
 #include <kernel/kernel.h>
 #include <kernel/klog.h>
@@ -8,97 +9,178 @@
 
 #include "con.h"
 #include "vga.h"
+#include "pit.h"
 
 #define TAB_WIDTH 4
 
+// Text mode geometry
+#define CON_COLUMNS     80
+#define CON_ROWS        25
+
+// Text mode video memory: 32KiB, of which the CRT shows one screen's worth
+// from the start address on
+#define VGA_TEXT_MEMORY 0xb8000
+#define VGA_TEXT_SIZE   0x8000
+
+// Whole rows that fit in video memory, and in each console's share of it
+#define CON_VRAM_ROWS   (VGA_TEXT_SIZE / (CON_COLUMNS * 2))
+#define CON_REGION_ROWS (CON_VRAM_ROWS / CON_COUNT)
+
 struct video_cell {
     char cellchar;
     u8   flags;
 };
 
-static struct video_cell *s_video_ptr;
-static int s_index;
-static int s_video_cell_flags;
+// Each console owns a region of video memory, and its screen is a window
+// onto that region. Scrolling moves the window down by reprogramming the CRT
+// start address rather than moving the text; only when the window reaches
+// the end of the region is what's still on screen copied back to its start.
+// Switching consoles is just pointing the CRT at another region.
+struct console {
+    int first_row;      // Region's first row of video memory
+    volatile int top;   // First row on screen, relative to the region
+    int index;          // Cursor, in cells from the top left of the screen
+    int cell_flags;
+};
+
+// Everything is drawn into a shadow copy of video memory in normal memory,
+// and the rows that changed are copied out once per tick. Video memory is
+// uncached, so this turns a burst of writes to one row into a single copy.
+static struct video_cell s_shadow[CON_COLUMNS * CON_VRAM_ROWS];
+static struct video_cell *s_vram;
+
+static struct console s_consoles[CON_COUNT];
+
+// Console on screen
+static struct console *volatile s_active = &s_consoles[0];
+
+// What the CRT was last told: the start address and cursor location, in
+// cells from the start of video memory
+static int s_shown_start = -1;
+static int s_shown_cursor = -1;
+
+// Rows of video memory that differ from the shadow, a bit each. Set after
+// the change, so a flush that interrupts a write is followed by another.
+static volatile u32 s_dirty_rows[(CON_VRAM_ROWS + 31) / 32];
+
+// Until the PIT flushes for us, writes go straight through
+static bool s_deferred;
 static int s_video_width;
 static int s_video_height;
 
-static int set_index(int index)
+// Marks a row of video memory, not of the screen
+static INLINE void mark_row_dirty(int row)
+{
+    __atomic_or_fetch(&s_dirty_rows[row / 32], BITFLAG(row % 32),
+        __ATOMIC_RELAXED);
+}
+
+// Screen row 0 of a console, in the shadow
+static INLINE struct video_cell *screen(const struct console *con)
+{
+    return s_shadow + (con->first_row + con->top) * s_video_width;
+}
+
+static INLINE void flush_if_direct(void)
+{
+    if (!s_deferred) {
+        con_flush();
+    }
+}
+
+static int set_index(struct console *con, int index)
 {
     index = MAX(index, 0);
     index = MIN(index, s_video_width * s_video_height);
-    s_index = index;
+    con->index = index;
 
-    // Place the VGA cursor at the location
-    vga_set_cursor_location((u16) index);
+    // The hardware cursor follows at the next flush. Moving it is four port
+    // writes, far more than drawing the character.
 
-    return s_index;
+    return con->index;
 }
 
-static void scroll_screen(int lines)
+static void scroll_screen(struct console *con, int lines)
 {
+    int keep;
     int i;
     struct video_cell *curr_line_ptr;
-    struct video_cell *next_line_ptr;
     const struct video_cell clear_cell = {
         .cellchar = 0,
-        .flags = (u8) s_video_cell_flags
+        .flags = (u8) con->cell_flags
     };
 
     lines = MAX(lines, 0);
     lines = MIN(lines, s_video_height);
-
-    curr_line_ptr = s_video_ptr;
-    next_line_ptr = curr_line_ptr + s_video_width * lines;
-
-    i = s_video_width * (s_video_height - lines);
-
-    // Move the topmost lines upwards
-    while (i--) {
-        *(curr_line_ptr++) = *(next_line_ptr++);
+    keep = s_video_height - lines;
+
+    if (con->top + lines + s_video_height > CON_REGION_ROWS) {
+        // Out of room: move the lines that stay back to the region's start
+        memmove(s_shadow + con->first_row * s_video_width,
+            screen(con) + s_video_width * lines,
+            s_video_width * keep * sizeof(struct video_cell));
+        for (i = 0; i < keep; ++i) {
+            mark_row_dirty(con->first_row + i);
+        }
+        con->top = 0;
+    } else {
+        con->top += lines;
     }
 
-    // Clear the remainder of the sreen
+    // Clear the lines scrolled in
+    curr_line_ptr = screen(con) + s_video_width * keep;
     i = s_video_width * lines;
 
     while (i--) {
         *(curr_line_ptr++) = clear_cell;
     }
 
-    set_index(s_index - lines * s_video_width);
+    for (i = keep; i < s_video_height; ++i) {
+        mark_row_dirty(con->first_row + con->top + i);
+    }
+
+    set_index(con, con->index - lines * s_video_width);
 }
 
-static int seek(int offset)
+static int seek(struct console *con, int offset)
 {
-    int new_index = set_index(s_index + offset);
+    int new_index = set_index(con, con->index + offset);
 
     if (new_index >= s_video_width * s_video_height) {
-        scroll_screen(
+        scroll_screen(con,
             (new_index - s_video_width * s_video_height) / s_video_height + 1);
     }
 
-    return s_index;
+    return con->index;
 }
 
-static void put_char(char c)
+static void put_char(struct console *con, char c)
 {
     struct video_cell info = {
         .cellchar = c,
-        .flags = (u8) s_video_cell_flags
+        .flags = (u8) con->cell_flags
     };
 
-    seek(1);
+    seek(con, 1);
 
-    s_video_ptr[s_index - 1] = info;
+    screen(con)[con->index - 1] = info;
+    mark_row_dirty(con->first_row + con->top +
+        (con->index - 1) / s_video_width);
 }
 
 int con_init(struct kernel_boot_params *params)
 {
+    struct console *con = &s_consoles[0];
     int cursor_x = 0;
     int cursor_y = 0;
 
-    s_video_ptr = (struct video_cell *) 0xb8000;
-    s_video_width = 80;
-    s_video_height = 25;
+    s_vram = (struct video_cell *) VGA_TEXT_MEMORY;
+    s_video_width = CON_COLUMNS;
+    s_video_height = CON_ROWS;
+
+    // Carry on from whatever the boot loader left on screen, in the first
+    // console. The first flush then moves the CRT start address to it.
+    memcpy(s_shadow, s_vram, s_video_width * s_video_height * sizeof(*s_vram));
 
     // Use the cursor co-ordinates from the boot parameter block, providing
     // the block is present and the co-ordinates it describes are valid.
@@ -111,130 +193,268 @@ int con_init(struct kernel_boot_params *params)
         cursor_y = (int) params->cursor_y;
     }
 
-    set_index(cursor_x + cursor_y * s_video_width);
+    set_index(con, cursor_x + cursor_y * s_video_width);
 
     // Our default flags are the flags of whatever character cell is at the
     // initial cursor position.
-    s_video_cell_flags = (int) (s_video_ptr[s_index].flags);
+    con->cell_flags = (int) (screen(con)[con->index].flags);
+
+    // The others start out blank, in the same colours
+    for (int i = 1; i < CON_COUNT; ++i) {
+        s_consoles[i].first_row = i * CON_REGION_ROWS;
+        s_consoles[i].cell_flags = con->cell_flags;
+        console_clear(&s_consoles[i]);
+    }
+
+    klog_info(KLOG_CON, "%d consoles of %dx%d at %p\n", CON_COUNT,
+        s_video_width, s_video_height, s_vram);
+
+    return 0;
+}
+
+static unsigned long con_pit_callback(void)
+{
+    con_flush();
+    return 1;
+}
+
+int con_start_deferred_flush(void)
+{
+    if (pit_add_callback(con_pit_callback)) {
+        return 1;
+    }
+
+    s_deferred = true;
+    return 0;
+}
+
+void con_flush(void)
+{
+    size_t row_size = s_video_width * sizeof(struct video_cell);
+    const struct console *con = s_active;
+    int start;
+    int cursor;
+
+    for (size_t word = 0; word < ARRLEN(s_dirty_rows); ++word) {
+        u32 dirty = __atomic_exchange_n(&s_dirty_rows[word], 0,
+            __ATOMIC_ACQUIRE);
+
+        for (int row = word * 32; dirty; ++row, dirty >>= 1) {
+            if (dirty & 1) {
+                memcpy(s_vram + row * s_video_width,
+                    s_shadow + row * s_video_width, row_size);
+            }
+        }
+    }
+
+    // Scrolling and switching consoles, all in one register write
+    start = (con->first_row + con->top) * s_video_width;
+    if (start != s_shown_start) {
+        vga_set_mapping_address((u32) start);
+        s_shown_start = start;
+    }
+
+    cursor = start + con->index;
+    if (cursor != s_shown_cursor) {
+        vga_set_cursor_location((u16) cursor);
+        s_shown_cursor = cursor;
+    }
+}
+
+struct console *con_get(int number)
+{
+    if (number < 0 || number >= CON_COUNT) {
+        return NULL;
+    }
+    return &s_consoles[number];
+}
 
-    klog_printf("con: %dx%d at %p\n", s_video_width, s_video_height,
-        s_video_ptr);
+struct console *con_get_active(void)
+{
+    return s_active;
+}
+
+int con_switch(int number)
+{
+    struct console *con = con_get(number);
+
+    if (!con) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    s_active = con;
+    flush_if_direct();
 
     return 0;
 }
 
+void console_clear(struct console *con)
+{
+    scroll_screen(con, s_video_height);
+    set_index(con, 0);
+    flush_if_direct();
+}
+
 void con_clear(void)
 {
-    scroll_screen(s_video_height);
-    set_index(0);
+    console_clear(&s_consoles[0]);
 }
 
-static void type_carriage_return()
+static void type_carriage_return(struct console *con)
 {
-    seek(-(s_index % s_video_width));
+    seek(con, -(con->index % s_video_width));
 }
 
-static void type_newline()
+static void type_newline(struct console *con)
 {
-    seek(s_video_width - (s_index % s_video_width));
+    seek(con, s_video_width - (con->index % s_video_width));
 }
 
-static void type_tabulator()
+static void type_tabulator(struct console *con)
 {
-    seek(TAB_WIDTH - s_index % TAB_WIDTH);
+    seek(con, TAB_WIDTH - con->index % TAB_WIDTH);
 }
 
-static void type_backspace()
+static void type_backspace(struct console *con)
 {
-    if (s_index > 0) {
-        seek(-1);
-        put_char(' ');
-        seek(-1);
+    if (con->index > 0) {
+        seek(con, -1);
+        put_char(con, ' ');
+        seek(con, -1);
     }
 }
 
-static void type_unknown(char c)
+static void type_unknown(struct console *con, char c)
 {
     static const char HEX_DIGITS[16] = "0123456789abcdef";
 
-    put_char('~');
-    put_char(HEX_DIGITS[(c & 0xf0) >> 4]);
-    put_char(HEX_DIGITS[c & 0x0f]);
+    put_char(con, '~');
+    put_char(con, HEX_DIGITS[(c & 0xf0) >> 4]);
+    put_char(con, HEX_DIGITS[c & 0x0f]);
 }
 
-int con_write_char(char c)
+static int write_char(struct console *con, char c)
 {
     if (isprint(c)) {
-        put_char(c);
+        put_char(con, c);
         return 1;
     }
 
     switch (c) {
     default:
-        type_unknown(c);
+        type_unknown(con, c);
         break;
     case '\r':
-        type_carriage_return();
+        type_carriage_return(con);
         break;
     case '\n':
-        type_newline();
+        type_newline(con);
         break;
     case '\t':
-        type_tabulator();
+        type_tabulator(con);
         break;
     case '\b':
-        type_backspace();
+        type_backspace(con);
         break;
     }
 
     return 0;
 }
 
-int con_write_str(const char *str)
+int console_write_char(struct console *con, char c)
+{
+    int result = write_char(con, c);
+
+    flush_if_direct();
+
+    return result;
+}
+
+int console_write_str(struct console *con, const char *str)
 {
     if (!str) {
         return KERROR_ARG_NULL;
     }
 
     while (*str) {
-        con_write_char(*(str++));
+        write_char(con, *(str++));
     }
 
+    flush_if_direct();
+
     return 0;
 }
 
+int console_write(struct console *con, const char *str, size_t len)
+{
+    if (!str) {
+        return KERROR_ARG_NULL;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        write_char(con, str[i]);
+    }
+
+    flush_if_direct();
+
+    return 0;
+}
+
+int con_write_char(char c)
+{
+    return console_write_char(&s_consoles[0], c);
+}
+
+int con_write_str(const char *str)
+{
+    return console_write_str(&s_consoles[0], str);
+}
+
+int con_write(const char *str, size_t len)
+{
+    return console_write(&s_consoles[0], str, len);
+}
+
+static void con_sink_put(struct kio_sink *sink, const char *str, size_t len)
+{
+    (void) sink;
+    console_write(&s_consoles[0], str, len);
+}
+
+struct kio_sink con_sink = { con_sink_put };
+
 int con_get_background_colour(void)
 {
-    int flags = s_video_cell_flags;
+    int flags = s_consoles[0].cell_flags;
     return ((flags >> 4) & 0x07);
 }
 
 void con_set_background_colour(int colour)
 {
-    int flags = s_video_cell_flags;
+    int flags = s_consoles[0].cell_flags;
     flags &= ~(0x07 << 4);
     flags |= ((colour & 0x07) << 4);
-    s_video_cell_flags = flags;
+    s_consoles[0].cell_flags = flags;
 }
 
 int con_get_foreground_colour(void)
 {
-    int flags = s_video_cell_flags;
+    int flags = s_consoles[0].cell_flags;
     return (flags & 0x0f);
 }
 
 void con_set_foreground_colour(int colour)
 {
-    int flags = s_video_cell_flags;
+    int flags = s_consoles[0].cell_flags;
     flags &= ~0x0f;
     flags |= (colour & 0x0f);
-    s_video_cell_flags = flags;
+    s_consoles[0].cell_flags = flags;
 }
 
-void con_get_cursor_location(int *x, int *y)
+void console_get_cursor_location(const struct console *con, int *x, int *y)
 {
-    int xx = s_index % s_video_width;
-    int yy = s_index / s_video_width;
+    int xx = con->index % s_video_width;
+    int yy = con->index / s_video_width;
 
     if (x) {
         *x = xx;
@@ -245,7 +465,7 @@ void con_get_cursor_location(int *x, int *y)
     }
 }
 
-int con_set_cursor_location(int x, int y)
+int console_set_cursor_location(struct console *con, int x, int y)
 {
     if (x < 0 || x >= s_video_width) {
         return KERROR_ARG_OUT_OF_RANGE;
@@ -255,11 +475,21 @@ int con_set_cursor_location(int x, int y)
         return KERROR_ARG_OUT_OF_RANGE;
     }
 
-    set_index(x + y * s_video_width);
+    set_index(con, x + y * s_video_width);
 
     return 0;
 }
 
+void con_get_cursor_location(int *x, int *y)
+{
+    console_get_cursor_location(&s_consoles[0], x, y);
+}
+
+int con_set_cursor_location(int x, int y)
+{
+    return console_set_cursor_location(&s_consoles[0], x, y);
+}
+
 void con_set_cursor_shape(int shape)
 {
     switch (shape) {
@@ -1,8 +1,12 @@
 #ifndef _INC_CON
 #define _INC_CON 1
 
+#include <stddef.h>
+
 // For struct kernel_boot_params
 #include "boot.h"
+// For struct kio_sink
+#include "kio.h"
 
 #define COL_BLACK               0x00
 #define COL_BLUE                0x01
@@ -27,12 +31,50 @@ enum {
     CON_CURSOR_SHAPE_BLOCK,
 };
 
+// Virtual consoles, switched between with Alt+F1..F4. Console 0 is the
+// kernel's: the con_*() functions without a console argument write to it,
+// and so do kprintf() and the kernel log.
+#define CON_COUNT               4
+
+// Stats readouts, kept off the kernel console
+#define CON_STATS               3
+
+struct console;
+
 int con_init(struct kernel_boot_params *params);
 
+// Output is drawn into a shadow buffer, and only reaches the screen when
+// con_flush() copies out the rows that changed and moves the cursor.
+// At first every write flushes; once this is called, the PIT flushes once
+// per tick instead.
+int con_start_deferred_flush(void);
+void con_flush(void);
+
+// Returns console 'number', or NULL if there is no such console
+struct console *con_get(int number);
+
+// The console on screen
+struct console *con_get_active(void);
+
+// Puts console 'number' on screen. Nothing is copied; the CRT is pointed at
+// the console's part of video memory.
+int con_switch(int number);
+
+void console_clear(struct console *con);
+int console_write_char(struct console *con, char c);
+int console_write_str(struct console *con, const char *str);
+int console_write(struct console *con, const char *str, size_t len);
+void console_get_cursor_location(const struct console *con, int *x, int *y);
+int console_set_cursor_location(struct console *con, int x, int y);
+
 void con_clear(void);
 
 int con_write_char(char c);
 int con_write_str(const char *str);
+int con_write(const char *str, size_t len);
+
+// Writes to the kernel console, for kvfprintf() and klog
+extern struct kio_sink con_sink;
 
 int con_get_background_colour(void);
 void con_set_background_colour(int col);
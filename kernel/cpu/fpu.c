@@ -0,0 +1,276 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/fpu.h>
+#include <kernel/asm/cpustat.h>
+#include <kernel/asm/cpuid.h>
+#include <kernel/asm/misc.h>
+
+#include "fpu.h"
+#include "isr.h"
+#include "../panic.h"
+
+#define FPU_NM_VECTOR   0x07
+
+// Power-on default MXCSR: all SIMD exceptions masked, round to nearest
+#define MXCSR_DEFAULT   0x1f80
+
+static int s_features;
+
+// The context whose registers are currently live in the FPU, and the context
+// that is currently running. These differ whenever CR0.TS is set.
+static struct fpu_context *s_owner;
+static struct fpu_context *s_current;
+
+// FPU context of the boot thread of execution
+static struct fpu_context s_boot_context;
+
+// Freshly initialised state, loaded by a context on its first FPU use
+static struct fpu_state s_init_state;
+
+static u32 s_switch_count;
+
+// Nesting depth of kernel_fpu_begin(), and the EFLAGS to restore at the end
+// of the outermost section
+static int s_kernel_depth;
+static u32 s_kernel_eflags;
+
+static ALWAYS_INLINE void save_state(struct fpu_state *state)
+{
+    if (s_features & FPU_FEATURE_FXSR) {
+        ASM_VOLATILE(
+            "fxsave [%0]"::
+            "r"(state->area):
+            "memory"
+        );
+    } else {
+        ASM_VOLATILE(
+            "fnsave [%0]    \n\t"
+            "fwait          \n\t"::
+            "r"(state->area):
+            "memory"
+        );
+    }
+}
+
+static ALWAYS_INLINE void restore_state(const struct fpu_state *state)
+{
+    if (s_features & FPU_FEATURE_FXSR) {
+        ASM_VOLATILE(
+            "fxrstor [%0]"::
+            "r"(state->area):
+            "memory"
+        );
+    } else {
+        ASM_VOLATILE(
+            "frstor [%0]"::
+            "r"(state->area):
+            "memory"
+        );
+    }
+}
+
+static ALWAYS_INLINE void set_task_switched(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+// #NM: the current context used the FPU while CR0.TS was set. Hand the FPU
+// over to it, saving the previous owner's registers first.
+static void fpu_isr_unavailable(struct isr_frame *frame)
+{
+    struct fpu_context *ctx = s_current;
+
+    clts();
+
+    if (!ctx) {
+        paniccs(isr_frame_cpustat(frame), "cpu fpu unavailable\n");
+    }
+
+    if (s_owner == ctx) {
+        return;
+    }
+
+    if (s_owner) {
+        save_state(&s_owner->state);
+        s_owner->used = true;
+    }
+
+    restore_state(ctx->used ? &ctx->state : &s_init_state);
+
+    s_owner = ctx;
+    ++s_switch_count;
+}
+
+int fpu_init(void)
+{
+    struct cpuid_result features = cpuid(CPUID_QUERY_FEATURES);
+    u32 cr0;
+    u32 cr4;
+
+    if (!(features.d & CPUID_FEATURE_FPU)) {
+        klog_warn(KLOG_FPU, "no x87 fpu present\n");
+        return 1;
+    }
+
+    s_features = FPU_FEATURE_X87;
+
+    // Use the real FPU, report its errors through #MF, and have WAIT/FWAIT
+    // honour CR0.TS so that it also triggers lazy switching.
+    cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    if (features.d & CPUID_FEATURE_FXSR) {
+        s_features |= FPU_FEATURE_FXSR;
+        cr4 = read_cr4() | CR4_OSFXSR;
+
+        if (features.d & CPUID_FEATURE_SSE) {
+            s_features |= FPU_FEATURE_SSE;
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+
+        if (features.d & CPUID_FEATURE_SSE2) {
+            s_features |= FPU_FEATURE_SSE2;
+        }
+
+        write_cr4(cr4);
+    }
+
+    ASM_VOLATILE("fninit");
+
+    if (s_features & FPU_FEATURE_SSE) {
+        u32 mxcsr = MXCSR_DEFAULT;
+        ASM_VOLATILE(
+            "ldmxcsr [%0]"::
+            "r"(&mxcsr):
+            "memory"
+        );
+    }
+
+    save_state(&s_init_state);
+
+    if (isr_set_handler(FPU_NM_VECTOR, fpu_isr_unavailable)) {
+        klog_err(KLOG_FPU, "failed to register isr %#04x\n", FPU_NM_VECTOR);
+        return 1;
+    }
+
+    // Whoever called us is the first context. Nobody owns the FPU yet, so its
+    // first FPU instruction will trap and load the initial state.
+    fpu_context_init(&s_boot_context);
+    s_current = &s_boot_context;
+    s_owner = NULL;
+    set_task_switched();
+
+    klog_info(KLOG_FPU, "x87%s%s%s enabled, lazy switching\n",
+        (s_features & FPU_FEATURE_FXSR) ? " fxsr" : "",
+        (s_features & FPU_FEATURE_SSE) ? " sse" : "",
+        (s_features & FPU_FEATURE_SSE2) ? " sse2" : "");
+
+    return 0;
+}
+
+int fpu_get_features(void)
+{
+    return s_features;
+}
+
+void fpu_context_init(struct fpu_context *ctx)
+{
+    KZEROMEM(ctx, sizeof(*ctx));
+    ctx->used = false;
+}
+
+void fpu_context_copy(struct fpu_context *dst, struct fpu_context *src)
+{
+    if (s_owner == src) {
+        u32 cr0 = read_cr0();
+
+        clts();
+        save_state(&src->state);
+        src->used = true;
+
+        // FNSAVE also reinitialises the FPU, and src still owns it
+        if (!(s_features & FPU_FEATURE_FXSR)) {
+            restore_state(&src->state);
+        }
+
+        write_cr0(cr0);
+    }
+
+    *dst = *src;
+}
+
+void fpu_switch_context(struct fpu_context *ctx)
+{
+    s_current = ctx;
+
+    if (ctx == s_owner) {
+        clts();
+    } else {
+        set_task_switched();
+    }
+}
+
+struct fpu_context *fpu_get_current_context(void)
+{
+    return s_current;
+}
+
+void fpu_context_release(struct fpu_context *ctx)
+{
+    if (s_owner == ctx) {
+        s_owner = NULL;
+        set_task_switched();
+    }
+
+    if (s_current == ctx) {
+        s_current = NULL;
+    }
+}
+
+u32 fpu_get_switch_count(void)
+{
+    return s_switch_count;
+}
+
+bool kernel_fpu_usable(void)
+{
+    return (bool) (s_features & FPU_FEATURE_SSE2);
+}
+
+void kernel_fpu_begin(void)
+{
+    u32 eflags = get_eflags();
+
+    cli();
+
+    if (s_kernel_depth++) {
+        return;
+    }
+
+    s_kernel_eflags = eflags;
+
+    clts();
+
+    // Park the owner's registers. Nobody owns the FPU during the section,
+    // so the owner will take the #NM path to get them back afterwards.
+    if (s_owner) {
+        save_state(&s_owner->state);
+        s_owner->used = true;
+        s_owner = NULL;
+    }
+}
+
+void kernel_fpu_end(void)
+{
+    if (--s_kernel_depth) {
+        return;
+    }
+
+    set_task_switched();
+
+    if (s_kernel_eflags & EFLAGS_IF) {
+        sti();
+    }
+}
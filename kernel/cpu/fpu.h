@@ -0,0 +1,69 @@
+#ifndef _INC_FPU
+#define _INC_FPU 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+
+// FPU/SSE state management.
+//
+// FPU state is switched lazily. Each thread of execution owns a struct
+// fpu_context. On a context switch the scheduler calls fpu_switch_context(),
+// which only sets CR0.TS. The first FPU/SSE instruction the new context
+// executes then raises #NM, and only at that point is the previous owner's
+// state saved and the new context's state loaded. Contexts that never touch
+// the FPU never pay for a save or restore.
+//
+// Kernel code that wants SIMD registers uses the kernel_fpu_begin()/end()
+// API in <kernel/fpu.h>.
+
+// Size of the FXSAVE area. The legacy FSAVE format (108B) fits inside it.
+#define FPU_STATE_SIZE  512
+
+// Saved FPU register state. Must be 16-byte aligned for FXSAVE/FXRSTOR.
+struct fpu_state {
+    u8 area[FPU_STATE_SIZE];
+} ALIGN(16);
+
+struct fpu_context {
+    struct fpu_state    state;
+    bool                used;       // state holds valid saved registers
+};
+
+// Feature flags, as detected by fpu_init()
+enum {
+    FPU_FEATURE_X87     = 0x01,
+    FPU_FEATURE_FXSR    = 0x02,
+    FPU_FEATURE_SSE     = 0x04,
+    FPU_FEATURE_SSE2    = 0x08,
+};
+
+// Detects the FPU and SIMD extensions via cpuid, enables them in CR0/CR4,
+// and installs the #NM handler. The caller becomes the first FPU context.
+int fpu_init(void);
+
+// Returns FPU_FEATURE_* flags for what fpu_init() enabled.
+int fpu_get_features(void);
+
+// Prepares a context for first use. Its first FPU instruction will load a
+// freshly initialised FPU state.
+void fpu_context_init(struct fpu_context *ctx);
+
+// Makes dst a copy of src's FPU state, e.g. for a forked thread. src's
+// registers are saved first if it owns the FPU.
+void fpu_context_copy(struct fpu_context *dst, struct fpu_context *src);
+
+// Makes ctx the current FPU context. Called when switching threads.
+void fpu_switch_context(struct fpu_context *ctx);
+
+// The context made current by the last fpu_switch_context(), or the boot
+// context set up by fpu_init().
+struct fpu_context *fpu_get_current_context(void);
+
+// Forgets ctx, e.g. when its thread exits, so its state is never saved.
+void fpu_context_release(struct fpu_context *ctx);
+
+// Returns the number of lazy FPU state switches (#NM traps) so far.
+u32 fpu_get_switch_count(void);
+
+#endif /* _INC_FPU */
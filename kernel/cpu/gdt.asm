@@ -0,0 +1,31 @@
+[bits 32]
+
+global gdt_load
+global tss_load
+
+; Must agree with cpu/gdt.h
+%define KERNEL_CODE_SELECTOR        0x08
+%define KERNEL_DATA_SELECTOR        0x10
+
+; void gdt_load(const struct gdt_descriptor *descriptor)
+; Loads the GDT, then reloads every segment register from it.
+gdt_load:
+    mov         eax, [esp+4]
+    lgdt        [eax]
+
+    mov         ax, KERNEL_DATA_SELECTOR
+    mov         ds, ax
+    mov         es, ax
+    mov         fs, ax
+    mov         gs, ax
+    mov         ss, ax
+
+    jmp         KERNEL_CODE_SELECTOR:.reload_cs
+.reload_cs:
+    ret
+
+; void tss_load(u16 selector)
+tss_load:
+    mov         ax, [esp+4]
+    ltr         ax
+    ret
@@ -1,10 +1,30 @@
+#include <kernel/kernel.h>
 #include <kernel/compiler.h>
 #include <kernel/types.h>
+#include <kernel/klog.h>
 
 #include "gdt.h"
 
+// Access byte flags
+#define GDT_ACCESS_PRESENT      0x80
+#define GDT_ACCESS_RING_0       0x00
+#define GDT_ACCESS_RING_3       0x60
+#define GDT_ACCESS_SEGMENT      0x10 // Code/data, as opposed to system
+#define GDT_ACCESS_EXECUTABLE   0x08
+#define GDT_ACCESS_RW           0x02 // Readable code / writable data
+#define GDT_ACCESS_TSS_32       0x09 // Available 32-bit TSS (system)
+
+// Granularity nibble flags
+#define GDT_FLAG_4K             0x08 // Limit is in 4KiB units
+#define GDT_FLAG_32BIT          0x04
+
 BEGIN_PACK struct gdt_entry {
-    // TODO
+    u16 limit_low;
+    u16 base_low;
+    u8  base_mid;
+    u8  access;
+    u8  flags_limit_high;   // Flags in the high nibble, limit 19:16 in low
+    u8  base_high;
 } END_PACK;
 
 // 48-bit GDT descriptor, for use with lgdt and sgdt
@@ -12,3 +32,106 @@ BEGIN_PACK struct gdt_descriptor {
     u16                 size;
     struct gdt_entry    *base;
 } END_PACK;
+
+// 32-bit task state segment. We only use it for the ring 0 stack on
+// privilege level changes; hardware task switching is not used. Every field
+// is naturally aligned, so the struct needs no packing.
+struct tss {
+    u32 prev_tss;
+    u32 esp0;
+    u32 ss0;
+    u32 esp1;
+    u32 ss1;
+    u32 esp2;
+    u32 ss2;
+    u32 cr3;
+    u32 eip;
+    u32 eflags;
+    u32 eax;
+    u32 ecx;
+    u32 edx;
+    u32 ebx;
+    u32 esp;
+    u32 ebp;
+    u32 esi;
+    u32 edi;
+    u32 es;
+    u32 cs;
+    u32 ss;
+    u32 ds;
+    u32 fs;
+    u32 gs;
+    u32 ldt;
+    u16 trap;
+    u16 iomap_base;
+};
+
+enum {
+    GDT_INDEX_NULL,
+    GDT_INDEX_KERNEL_CODE,
+    GDT_INDEX_KERNEL_DATA,
+    GDT_INDEX_USER_CODE,
+    GDT_INDEX_USER_DATA,
+    GDT_INDEX_TSS,
+    GDT_ENTRIES,
+};
+
+static struct gdt_entry s_gdt[GDT_ENTRIES] ALIGN(8);
+static struct tss s_tss;
+
+static void set_entry(int index, u32 base, u32 limit, u8 access, u8 flags)
+{
+    struct gdt_entry *entry = &s_gdt[index];
+
+    entry->limit_low = (u16) (limit & 0xffff);
+    entry->base_low = (u16) (base & 0xffff);
+    entry->base_mid = (u8) ((base >> 16) & 0xff);
+    entry->access = access;
+    entry->flags_limit_high = (u8) ((flags << 4) | ((limit >> 16) & 0x0f));
+    entry->base_high = (u8) ((base >> 24) & 0xff);
+}
+
+int gdt_init(void)
+{
+    struct gdt_descriptor descriptor;
+    const u8 code = GDT_ACCESS_PRESENT | GDT_ACCESS_SEGMENT |
+        GDT_ACCESS_EXECUTABLE | GDT_ACCESS_RW;
+    const u8 data = GDT_ACCESS_PRESENT | GDT_ACCESS_SEGMENT | GDT_ACCESS_RW;
+    const u8 flat = GDT_FLAG_4K | GDT_FLAG_32BIT;
+
+    KZEROMEM(s_gdt, sizeof(s_gdt));
+    KZEROMEM(&s_tss, sizeof(s_tss));
+
+    // Flat 4GiB segments for both rings
+    set_entry(GDT_INDEX_KERNEL_CODE, 0, 0xfffff, code | GDT_ACCESS_RING_0, flat);
+    set_entry(GDT_INDEX_KERNEL_DATA, 0, 0xfffff, data | GDT_ACCESS_RING_0, flat);
+    set_entry(GDT_INDEX_USER_CODE, 0, 0xfffff, code | GDT_ACCESS_RING_3, flat);
+    set_entry(GDT_INDEX_USER_DATA, 0, 0xfffff, data | GDT_ACCESS_RING_3, flat);
+
+    // No I/O permission bitmap: the map base points past the TSS limit.
+    s_tss.ss0 = GDT_KERNEL_DATA_SELECTOR;
+    s_tss.iomap_base = (u16) sizeof(s_tss);
+    set_entry(GDT_INDEX_TSS, (u32) &s_tss, sizeof(s_tss) - 1,
+        GDT_ACCESS_PRESENT | GDT_ACCESS_RING_0 | GDT_ACCESS_TSS_32, 0);
+
+    descriptor.size = (u16) (sizeof(s_gdt) - 1);
+    descriptor.base = s_gdt;
+
+    gdt_load(&descriptor);
+    tss_load(GDT_TSS_SELECTOR);
+
+    klog_info(KLOG_GDT, "loaded at %p with %d entries, tss at %p\n", s_gdt,
+        GDT_ENTRIES, &s_tss);
+
+    return 0;
+}
+
+void gdt_set_kernel_stack(u32 esp0)
+{
+    s_tss.esp0 = esp0;
+}
+
+const u32 *gdt_get_kernel_stack_slot(void)
+{
+    return &s_tss.esp0;
+}
@@ -1,4 +1,32 @@
 #ifndef _INC_GDT
 #define _INC_GDT 1
 
+#include <kernel/types.h>
+
+// Segment selectors of the kernel-owned GDT.
+// These values MUST agree with the values used in the .asm files, and the
+// kernel code/data selectors with the bootloader's GDT in boot/boot.asm.
+// SYSENTER/SYSEXIT also require user code/data to follow kernel code/data in
+// exactly this order.
+#define GDT_KERNEL_CODE_SELECTOR    0x08
+#define GDT_KERNEL_DATA_SELECTOR    0x10
+#define GDT_USER_CODE_SELECTOR      0x1b    // Index 3, RPL 3
+#define GDT_USER_DATA_SELECTOR      0x23    // Index 4, RPL 3
+#define GDT_TSS_SELECTOR            0x28
+
+// Replaces the bootloader's GDT with one that also has ring 3 segments and a
+// TSS, and loads the task register.
+int gdt_init(void);
+
+// Sets the stack the CPU switches to when entering ring 0 from ring 3.
+void gdt_set_kernel_stack(u32 esp0);
+
+// Location of the ring 0 stack pointer within the TSS. SYSENTER uses this to
+// find the kernel stack without an MSR write per context switch.
+const u32 *gdt_get_kernel_stack_slot(void);
+
+// Implemented in cpu/gdt.asm
+void gdt_load(const void *descriptor);
+void tss_load(u16 selector);
+
 #endif /* _INC_GDT */
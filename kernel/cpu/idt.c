@@ -62,7 +62,7 @@ int idt_init(void)
 
     load_descriptor((int) sizeof(s_idt), s_idt);
 
-    klog_printf("idt: loaded at %p with %d entries (%zuB)\n", s_idt,
+    klog_info(KLOG_IDT, "loaded at %p with %d entries (%zuB)\n", s_idt,
         ARRLEN(s_idt), sizeof(s_idt));
 
     return 0;
@@ -70,7 +70,7 @@ int idt_init(void)
 
 static INLINE bool _is_valid_index(int index)
 {
-    return ((index >= 0) && (index <= IDT_MAX));
+    return ((index >= 0) && (index < IDT_MAX));
 }
 
 bool idt_is_valid_index(int index)
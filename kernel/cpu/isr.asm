@@ -0,0 +1,78 @@
+[bits 32]
+
+global isr_stub_table
+global isr_exit
+
+extern isr_dispatch
+
+; Number of IDT vectors we generate entry stubs for - must agree with IDT_MAX
+; in cpu/idt.h.
+%define ISR_STUB_COUNT              256
+
+; Kernel data segment selector - must agree with cpu/gdt.h.
+%define KERNEL_DATA_SELECTOR        0x10
+
+; The CPU only pushes an error code for a handful of exceptions. For every
+; other vector the stub pushes a dummy zero so that the trap frame always has
+; the same layout (see struct isr_frame in cpu/isr.h).
+%define ISR_HAS_ERROR_CODE(n)       ((n) == 0x08 || \
+                                    ((n) >= 0x0a && (n) <= 0x0e) || \
+                                     (n) == 0x11 || (n) == 0x15 || \
+                                     (n) == 0x1d || (n) == 0x1e)
+
+    [section .text]
+
+; Per-vector entry stubs. Each pushes (dummy) error code and vector number,
+; then joins the common path.
+%assign i 0
+%rep ISR_STUB_COUNT
+isr_stub_ %+ i:
+%if !ISR_HAS_ERROR_CODE(i)
+    push        dword 0                         ; Dummy error code
+%endif
+    push        dword i                         ; Vector number
+    jmp         isr_common
+%assign i i+1
+%endrep
+
+; Common entry path. Completes the trap frame, switches to the kernel data
+; segments and hands a pointer to the frame to isr_dispatch(). Whatever the
+; handler leaves in the frame is restored on the way out.
+isr_common:
+    pushad
+    push        ds
+    push        es
+    push        fs
+    push        gs
+
+    mov         ax, KERNEL_DATA_SELECTOR
+    mov         ds, ax
+    mov         es, ax
+    mov         fs, ax
+    mov         gs, ax
+
+    cld                                         ; C ABI expects DF clear
+    push        esp                             ; struct isr_frame *frame
+    call        isr_dispatch
+    add         esp, 4
+
+; Restores a trap frame and returns from the interrupt. New processes start
+; here, with a frame built by proc.c on their kernel stack.
+isr_exit:
+    pop         gs
+    pop         fs
+    pop         es
+    pop         ds
+    popad
+    add         esp, 8                          ; Vector and error code
+    iretd
+
+    [section .rodata]
+
+; Entry stub addresses, indexed by vector number.
+isr_stub_table:
+%assign i 0
+%rep ISR_STUB_COUNT
+    dd          isr_stub_ %+ i
+%assign i i+1
+%endrep
@@ -1,34 +1,59 @@
+#include <kernel/kernel.h>
 #include <kernel/klog.h>
+#include <kernel/irqtrace.h>
+#include <kernel/asm/misc.h>
 
 #include "isr.h"
 #include "idt.h"
 #include "../panic.h"
+#include "../proc.h"
+#include "../mem/vm.h"
 
 // Reference: https://support.microsoft.com/en-us/kb/117389
 // Note: reference refers to FPU as 'coprocessor'
 
-static ISR_DEF_HANDLER(isr_divide_error);
-static ISR_DEF_HANDLER(isr_nonmaskable_interrupt);
-static ISR_DEF_HANDLER(isr_bounds_check);
-static ISR_DEF_HANDLER(isr_invalid_opcode);
-static ISR_DEF_HANDLER(isr_fpu_unavailable);
-static ISR_DEF_HANDLER(isr_double_fault);
-static ISR_DEF_HANDLER(isr_fpu_segment_overrun);
-static ISR_DEF_HANDLER(isr_invalid_tss);
-static ISR_DEF_HANDLER(isr_segment_not_present);
-static ISR_DEF_HANDLER(isr_stack_exception);
-static ISR_DEF_HANDLER(isr_general_protection_fault);
-static ISR_DEF_HANDLER(isr_page_fault);
-static ISR_DEF_HANDLER(isr_fpu_error);
+// Entry stubs generated by cpu/isr.asm, indexed by vector number.
+extern void (*const isr_stub_table[IDT_MAX])(void);
+
+// C handlers, indexed by vector number. Looked up by isr_dispatch().
+static isr_handler_t s_handlers[IDT_MAX];
+
+static void isr_divide_error(struct isr_frame *frame);
+static void isr_nonmaskable_interrupt(struct isr_frame *frame);
+static void isr_bounds_check(struct isr_frame *frame);
+static void isr_invalid_opcode(struct isr_frame *frame);
+static void isr_fpu_unavailable(struct isr_frame *frame);
+static void isr_double_fault(struct isr_frame *frame);
+static void isr_fpu_segment_overrun(struct isr_frame *frame);
+static void isr_invalid_tss(struct isr_frame *frame);
+static void isr_segment_not_present(struct isr_frame *frame);
+static void isr_stack_exception(struct isr_frame *frame);
+static void isr_general_protection_fault(struct isr_frame *frame);
+static void isr_page_fault(struct isr_frame *frame);
+static void isr_fpu_error(struct isr_frame *frame);
+static void isr_simd_error(struct isr_frame *frame);
+
+static INLINE int __set_handler_dpl(int isrnum, isr_handler_t handler,
+    int privilege)
+{
+    int result = idt_set_entry(isrnum, isr_stub_table[isrnum], 0x8,
+        IDT_PRESENT | privilege | IDT_GATE_INTERRUPT_32);
+
+    if (!result) {
+        s_handlers[isrnum] = handler;
+    }
+
+    return result;
+}
 
-static INLINE int __set_handler(int isrnum, void (*handler)(void))
+static INLINE int __set_handler(int isrnum, isr_handler_t handler)
 {
-    return idt_set_entry(isrnum, handler, 0x8, IDT_PRESENT | IDT_PRIVILEGE_0 |
-        IDT_GATE_INTERRUPT_32);
+    return __set_handler_dpl(isrnum, handler, IDT_PRIVILEGE_0);
 }
 
 static INLINE int __remove_handler(int isrnum)
 {
+    s_handlers[isrnum] = NULL;
     return idt_set_entry(isrnum, 0, 0, 0);
 }
 
@@ -37,35 +62,42 @@ int isr_init(void)
     int result = 0;
 
     // CPU Exceptions (some omitted):
-    result |= __set_handler(0x00, ISR_HANDLER(isr_divide_error));
+    result |= __set_handler(0x00, isr_divide_error);
     // 0x01 Single-step/Debug (Trap Gate)
-    result |= __set_handler(0x02, ISR_HANDLER(isr_nonmaskable_interrupt));
+    result |= __set_handler(0x02, isr_nonmaskable_interrupt);
     // 0x03 Breakpoint (Trap Gate)
     // 0x04 Overflow (Trap Gate)
-    result |= __set_handler(0x05, ISR_HANDLER(isr_bounds_check));
-    result |= __set_handler(0x06, ISR_HANDLER(isr_invalid_opcode));
-    result |= __set_handler(0x07, ISR_HANDLER(isr_fpu_unavailable));
-    result |= __set_handler(0x08, ISR_HANDLER(isr_double_fault));
-    result |= __set_handler(0x09, ISR_HANDLER(isr_fpu_segment_overrun));
-    result |= __set_handler(0x0a, ISR_HANDLER(isr_invalid_tss));
-    result |= __set_handler(0x0b, ISR_HANDLER(isr_segment_not_present));
-    result |= __set_handler(0x0c, ISR_HANDLER(isr_stack_exception));
-    result |= __set_handler(0x0d, ISR_HANDLER(isr_general_protection_fault));
-    result |= __set_handler(0x0e, ISR_HANDLER(isr_page_fault));
+    result |= __set_handler(0x05, isr_bounds_check);
+    result |= __set_handler(0x06, isr_invalid_opcode);
+    result |= __set_handler(0x07, isr_fpu_unavailable);
+    result |= __set_handler(0x08, isr_double_fault);
+    result |= __set_handler(0x09, isr_fpu_segment_overrun);
+    result |= __set_handler(0x0a, isr_invalid_tss);
+    result |= __set_handler(0x0b, isr_segment_not_present);
+    result |= __set_handler(0x0c, isr_stack_exception);
+    result |= __set_handler(0x0d, isr_general_protection_fault);
+    result |= __set_handler(0x0e, isr_page_fault);
     // 0xf Reserved by Intel
-    result |= __set_handler(0x10, ISR_HANDLER(isr_fpu_error));
+    result |= __set_handler(0x10, isr_fpu_error);
+    // 0x11 Alignment Check
+    // 0x12 Machine Check
+    result |= __set_handler(0x13, isr_simd_error);
 
     if (result) {
-        klog_printf("isr: failed to register one or more cpu isr handlers\n");
+        klog_err(KLOG_ISR, "failed to register one or more cpu isr handlers\n");
         return 1;
     }
 
-    klog_printf("isr: registered cpu isr handlers\n");
+    klog_info(KLOG_ISR, "registered cpu isr handlers\n");
     return 0;
 }
 
-int isr_set_handler(int isrnum, void (*handler)(void))
+int isr_set_handler(int isrnum, isr_handler_t handler)
 {
+    if (!idt_is_valid_index(isrnum)) {
+        return 1;
+    }
+
     if (handler) {
         return __set_handler(isrnum, handler);
     } else {
@@ -73,67 +105,146 @@ int isr_set_handler(int isrnum, void (*handler)(void))
     }
 }
 
-void isr_divide_error(struct isr_params params)
+int isr_set_user_handler(int isrnum, isr_handler_t handler)
+{
+    if (!idt_is_valid_index(isrnum) || !handler) {
+        return 1;
+    }
+
+    return __set_handler_dpl(isrnum, handler, IDT_PRIVILEGE_3);
+}
+
+void CDECL isr_dispatch(struct isr_frame *frame)
+{
+#if IRQ_TRACE
+    u64 start_tsc = rdtsc();
+#endif
+
+    isr_handler_t handler = s_handlers[frame->vector & (IDT_MAX - 1)];
+
+    if (!handler) {
+        paniccs(isr_frame_cpustat(frame), "unhandled interrupt %#04x\n",
+            frame->vector);
+    }
+
+    handler(frame);
+
+#if IRQ_TRACE
+    irqtrace_isr_exit(frame->vector, start_tsc);
+#endif
+
+    proc_preempt(frame);
+}
+
+static void isr_divide_error(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu divide error\n");
+    proc_fault(frame, "divide error");
+
+    paniccs(isr_frame_cpustat(frame), "cpu divide error at %p\n",
+        (void *) frame->eip);
 }
 
-void isr_nonmaskable_interrupt(struct isr_params params)
+static void isr_nonmaskable_interrupt(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu non-maskable hardware interrupt\n");
+    paniccs(isr_frame_cpustat(frame), "cpu non-maskable hardware interrupt\n");
 }
 
-void isr_bounds_check(struct isr_params params)
+static void isr_bounds_check(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu bounds limit exceeded\n");
+    proc_fault(frame, "bounds limit exceeded");
+
+    paniccs(isr_frame_cpustat(frame), "cpu bounds limit exceeded at %p\n",
+        (void *) frame->eip);
+}
+
+static void isr_invalid_opcode(struct isr_frame *frame)
+{
+    proc_fault(frame, "invalid opcode");
+
+    paniccs(isr_frame_cpustat(frame), "cpu invalid opcode at %p\n",
+        (void *) frame->eip);
 }
 
-void isr_invalid_opcode(struct isr_params params)
+static void isr_fpu_unavailable(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu invalid opcode\n");
+    paniccs(isr_frame_cpustat(frame), "cpu fpu unavailable\n");
 }
 
-void isr_fpu_unavailable(struct isr_params params)
+static void isr_double_fault(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu fpu unavailable\n");
+    paniccs(isr_frame_cpustat(frame), "cpu double-fault\n");
 }
 
-void isr_double_fault(struct isr_params params)
+static void isr_fpu_segment_overrun(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu double-fault\n");
+    paniccs(isr_frame_cpustat(frame), "cpu fpu segment overrun\n");
 }
 
-void isr_fpu_segment_overrun(struct isr_params params)
+static void isr_invalid_tss(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu fpu segment overrun\n");
+    paniccs(isr_frame_cpustat(frame), "cpu invalid TSS (selector %#x)\n",
+        frame->error_code);
 }
 
-void isr_invalid_tss(struct isr_params params)
+static void isr_segment_not_present(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu invalid TSS\n");
+    proc_fault(frame, "segment not present");
+
+    paniccs(isr_frame_cpustat(frame),
+        "cpu segment not present (selector %#x)\n", frame->error_code);
 }
 
-void isr_segment_not_present(struct isr_params params)
+static void isr_stack_exception(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu segment not present\n");
+    proc_fault(frame, "stack exception");
+
+    paniccs(isr_frame_cpustat(frame), "cpu stack exception (selector %#x)\n",
+        frame->error_code);
 }
 
-void isr_stack_exception(struct isr_params params)
+static void isr_general_protection_fault(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu stack exception\n");
+    proc_fault(frame, "general protection fault");
+
+    paniccs(isr_frame_cpustat(frame),
+        "cpu general protection fault at %p (error %#x)\n",
+        (void *) frame->eip, frame->error_code);
 }
 
-void isr_general_protection_fault(struct isr_params params)
+static void isr_page_fault(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu general protection fault\n");
+    // Error code bits: 0 - protection violation (vs. not present),
+    // 1 - write access, 2 - user mode access.
+    u32 err = frame->error_code;
+
+    // First touch of a demand-paged page, or a write to a copy-on-write one
+    if (!vm_handle_fault(read_cr2(), err & 0x2)) {
+        return;
+    }
+
+    proc_fault(frame, "page fault");
+
+    paniccs(isr_frame_cpustat(frame),
+        "cpu page fault at %p: %s %s of %p (%s)\n",
+        (void *) frame->eip,
+        (err & 0x4) ? "user" : "kernel",
+        (err & 0x2) ? "write" : "read",
+        (void *) read_cr2(),
+        (err & 0x1) ? "protection violation" : "page not present");
 }
 
-void isr_page_fault(struct isr_params params)
+static void isr_fpu_error(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu page fault\n");
+    proc_fault(frame, "fpu error");
+
+    paniccs(isr_frame_cpustat(frame), "cpu fpu error at %p\n",
+        (void *) frame->eip);
 }
 
-void isr_fpu_error(struct isr_params params)
+static void isr_simd_error(struct isr_frame *frame)
 {
-    paniccs(params.cs, "cpu fpu error\n");
+    proc_fault(frame, "simd floating-point error");
+
+    paniccs(isr_frame_cpustat(frame), "cpu simd floating-point error at %p\n",
+        (void *) frame->eip);
 }
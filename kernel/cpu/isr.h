@@ -2,6 +2,7 @@
 #define _INC_ISR 1
 
 #include <kernel/compiler.h>
+#include <kernel/types.h>
 
 #include <kernel/asm/cpustat.h>
 
@@ -9,65 +10,62 @@
 // service routines (ISRs). These are functions that will be called when a
 // given interrupt - CPU, hardware, or software - is invoked.
 
-// Due to the fact that interrupts have an abnormal calling convention,
-// registerred ISRs must be registered via a 'handler'. A handler is a wrapper
-// function a given ISR. One must be defined for each ISR.
+// Every vector enters the kernel through a small assembly stub (cpu/isr.asm),
+// which pushes the vector number and error code, saves the remaining register
+// state, and calls a single dispatcher. The dispatcher looks the vector up in
+// a table of plain C handlers, so handlers need no special calling convention.
 
-// ISRs are given
-struct isr_params {
-    struct cpustat cs;
+// Trap frame, as laid out on the stack by the entry stubs.
+// NOTE: The field order must agree with the push order in cpu/isr.asm.
+struct isr_frame {
+    // Segment registers, pushed by the common entry stub
+    u32 gs;
+    u32 fs;
+    u32 es;
+    u32 ds;
+
+    // General-purpose registers, pushed by PUSHA. Note that regset.sp is the
+    // kernel stack pointer at the time of the PUSHA, not the interrupted one.
+    struct register_set regset;
+
+    // Pushed by the per-vector entry stub
+    u32 vector;
+    u32 error_code;     // Zero for vectors without a CPU error code
+
+    // Pushed by the CPU
+    u32 eip;
+    u32 cs;
+    u32 eflags;
+
+    // Only pushed by the CPU on a privilege level change
+    u32 user_esp;
+    u32 user_ss;
 };
 
-// Gets the name of the ISR handler function
-#define ISR_HANDLER(ISRFUNC)    __handle_##ISRFUNC
-
-#define ISR_HANDLER_ATTR    /* None */
-
-// Template for ISR handler functions
-#define __ISR_HOOK_HANDLER_BASE(ISRFUNC, ISRBODY)       \
-    void ISR_HANDLER_ATTR ISRFUNC(void)                 \
-    {                                                   \
-        ASM_VOLATILE(                                   \
-            "pusha"                                     \
-        );                                              \
-        {                                               \
-            ISRBODY                                     \
-        }                                               \
-        ASM_VOLATILE(                                   \
-            "popa   \n\t"                               \
-            "leave  \n\t"                               \
-            "iret   \n\t"                               \
-        );                                              \
-    }
-
-// Standard ISR handler function
-// Gives the ISR an isr_params object, which contains information about the
-// state of the environment when the ISR was invoked. Note that this involves
-// a small amount of prior processing.
-#define ISR_DEF_HANDLER(ISRFUNC)                        \
-    __ISR_HOOK_HANDLER_BASE(ISR_HANDLER(ISRFUNC),       \
-    {                                                   \
-        extern void ISRFUNC(struct isr_params params);  \
-        struct isr_params params;                       \
-        params.cs = collect_cpustat();                  \
-        ISRFUNC(params);                                \
-    });
-
-// Parameterless ISR handler function
-// Performs no prior processing to acquire information about the ISR calling
-// environment. This makes it good for hardware interrupts.
-#define ISR_DEF_HANDLER_NOPARAMS(ISRFUNC)               \
-    __ISR_HOOK_HANDLER_BASE(ISR_HANDLER(ISRFUNC),       \
-    {                                                   \
-        extern void ISRFUNC(void);                      \
-        ISRFUNC();                                      \
-    });
+typedef void (*isr_handler_t)(struct isr_frame *frame);
+
+// Builds a cpustat from a trap frame, for use with paniccs() and friends.
+static INLINE struct cpustat isr_frame_cpustat(const struct isr_frame *frame)
+{
+    struct cpustat cs;
+    cs.regset = frame->regset;
+    cs.eflags = frame->eflags;
+    return cs;
+}
 
 // Initialise the ISR handling system, registering ISRs for all CPU exceptions
 int isr_init(void);
 
 // Sets the handler function for the ISR of a given number - the ISR number
-// being its index in the IDT, aka the interrupt number.
-int isr_set_handler(int isrnum, void (*handler)(void));
+// being its index in the IDT, aka the interrupt number. Passing a null handler
+// removes the IDT entry.
+int isr_set_handler(int isrnum, isr_handler_t handler);
+
+// As isr_set_handler(), but the vector may also be raised with INT from
+// ring 3 - for system call gates.
+int isr_set_user_handler(int isrnum, isr_handler_t handler);
+
+// Common entry point for all ISR stubs. Called from cpu/isr.asm only.
+void CDECL isr_dispatch(struct isr_frame *frame);
 
 #endif /* _INC_ISR */
@@ -0,0 +1,79 @@
+[bits 32]
+
+global sysenter_entry
+global sysenter_user_stub
+
+extern syscall_dispatch
+
+; Must agree with cpu/gdt.h and cpu/syscall.h
+%define KERNEL_DATA_SELECTOR        0x10
+%define USER_CODE_SELECTOR          0x1b
+%define USER_DATA_SELECTOR          0x23
+%define SYSCALL_IDT_INDEX           0x40
+
+    [section .user_text]
+
+; User-mode side of the SYSENTER path. Takes the same registers as int 0x40:
+; EAX = number, EBX/ECX/EDX = arguments, and returns the result in EAX.
+; SYSEXIT returns to sysenter_user_return with ESP taken from ECX, so the
+; registers it clobbers are saved on the user stack and EBP tells the kernel
+; where that stack is.
+sysenter_user_stub:
+    push        ebp
+    push        ecx
+    push        edx
+    mov         ebp, esp
+    sysenter
+sysenter_user_return:
+    pop         edx
+    pop         ecx
+    pop         ebp
+    ret
+
+    [section .text]
+
+; Kernel entry for SYSENTER. The CPU has loaded CS/SS from IA32_SYSENTER_CS,
+; cleared IF, and loaded ESP with the address of the TSS's ESP0 slot.
+; Builds the same trap frame as an int 0x40 (struct isr_frame in cpu/isr.h)
+; so both paths share syscall_dispatch().
+sysenter_entry:
+    mov         esp, [esp]                      ; Ring 0 stack from the TSS
+
+    ; What the CPU would have pushed for an int from ring 3. User EFLAGS are
+    ; not preserved across SYSENTER; a system call is a call boundary anyway.
+    push        dword USER_DATA_SELECTOR        ; user_ss
+    push        ebp                             ; user_esp
+    push        dword 0x202                     ; eflags (IF)
+    push        dword USER_CODE_SELECTOR        ; cs
+    push        dword sysenter_user_return      ; eip
+    push        dword 0                         ; Dummy error code
+    push        dword SYSCALL_IDT_INDEX         ; Vector number
+
+    pushad
+    push        ds
+    push        es
+    push        fs
+    push        gs
+
+    mov         ax, KERNEL_DATA_SELECTOR
+    mov         ds, ax
+    mov         es, ax
+    mov         fs, ax
+    mov         gs, ax
+
+    cld
+    push        esp                             ; struct isr_frame *frame
+    call        syscall_dispatch
+    add         esp, 4
+
+    pop         gs
+    pop         fs
+    pop         es
+    pop         ds
+    popad
+    add         esp, 8                          ; Vector and error code
+
+    mov         edx, [esp]                      ; eip
+    mov         ecx, [esp+12]                   ; user_esp
+    sti                                         ; Takes effect after SYSEXIT
+    sysexit
@@ -1,24 +1,236 @@
+#include <kernel/kernel.h>
 #include <kernel/klog.h>
+#include <kernel/kerror.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpuid.h>
 
 #include "syscall.h"
 #include "isr.h"
-#include "../panic.h"
+#include "gdt.h"
+#include "../kio.h"
+#include "../pit.h"
+#include "../mem/page.h"
+#include "../mem/vm.h"
+#include "../proc.h"
 
-static ISR_DEF_HANDLER(isr_syscall);
+struct syscall_entry {
+    syscall_fn_t    fn;
+    const char      *name;
+    u32             count;          // Times called
+    u32             max_cycles;     // Longest single call
+    u64             cycles;         // Cumulative TSC cycles in fn
+};
 
-void isr_syscall(struct isr_params params)
+static struct syscall_entry s_syscalls[SYSCALL_MAX];
+
+// Calls to numbers with no implementation
+static u32 s_bad_calls;
+
+// Whether SYSENTER is set up
+static bool s_sysenter;
+
+static INLINE u32 clamp_cycles(u64 cycles)
+{
+    return (cycles > 0xffffffffULL) ? 0xffffffff : (u32) cycles;
+}
+
+static u32 sys_null(u32 arg1, u32 arg2, u32 arg3)
+{
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+    return 0;
+}
+
+static u32 sys_write(u32 buf, u32 len, u32 arg3)
+{
+    const char *str = (const char *) buf;
+
+    (void) arg3;
+
+    if (!syscall_user_ptr_ok(str, len)) {
+        return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    kio_out_sink.put(&kio_out_sink, str, len);
+
+    return len;
+}
+
+static u32 sys_get_ticks(u32 arg1, u32 arg2, u32 arg3)
+{
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+    return (u32) pit_get_ms();
+}
+
+void CDECL syscall_dispatch(struct isr_frame *frame)
+{
+    u32 num = frame->regset.a;
+    struct syscall_entry *entry;
+    u64 start;
+    u64 cycles;
+
+    if (num >= SYSCALL_MAX || !s_syscalls[num].fn) {
+        ++s_bad_calls;
+        frame->regset.a = SYSCALL_ERROR(KERROR_NOT_IMPLEMENTED);
+        return;
+    }
+
+    entry = &s_syscalls[num];
+    // Kept per process, as a system call may switch process part way
+    proc_current()->syscall_from_user = ((frame->cs & 3) != 0);
+
+    start = rdtsc();
+    frame->regset.a = entry->fn(frame->regset.b, frame->regset.c,
+        frame->regset.d);
+    cycles = rdtsc() - start;
+
+    ++entry->count;
+    entry->cycles += cycles;
+    entry->max_cycles = MAX(entry->max_cycles, clamp_cycles(cycles));
+}
+
+// Early Pentium Pro steppings report SEP but lack a working SYSENTER.
+static bool sysenter_supported(void)
+{
+    struct cpuid_result id = cpuid(CPUID_QUERY_FEATURES);
+    u32 family = (id.a >> 8) & 0x0f;
+    u32 model = (id.a >> 4) & 0x0f;
+    u32 stepping = id.a & 0x0f;
+
+    if (!(id.d & CPUID_FEATURE_SYSENTER_SYSEXIT)) {
+        return false;
+    }
+
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+static void sysenter_init(void)
 {
-    paniccs(params.cs, "syscall unimplemented\n");
+    if (!sysenter_supported()) {
+        klog_warn(KLOG_SYSCALL, "sysenter unsupported, using int %#04x only\n",
+            SYSCALL_IDT_INDEX);
+        return;
+    }
+
+    // SYSENTER loads ESP straight from the MSR, so point it at the TSS's
+    // ESP0 slot and let the entry stub load the real stack from there.
+    wrmsr(MSR_IA32_SYSENTER_CS, GDT_KERNEL_CODE_SELECTOR);
+    wrmsr(MSR_IA32_SYSENTER_ESP, (u32) gdt_get_kernel_stack_slot());
+    wrmsr(MSR_IA32_SYSENTER_EIP, (u32) sysenter_entry);
+
+    s_sysenter = true;
+    klog_info(KLOG_SYSCALL, "sysenter enabled\n");
 }
 
 int syscall_init(void)
 {
-    if (isr_set_handler(SYSCALL_IDT_INDEX, ISR_HANDLER(isr_syscall))) {
-        klog_printf("syscall: failed to register isr %#2x\n", SYSCALL_IDT_INDEX);
+    int result = 0;
+
+    KZEROMEM(s_syscalls, sizeof(s_syscalls));
+
+    result |= syscall_register(SYS_NULL, sys_null, "null");
+    result |= syscall_register(SYS_WRITE, sys_write, "write");
+    result |= syscall_register(SYS_GET_TICKS, sys_get_ticks, "get_ticks");
+
+    if (result || isr_set_user_handler(SYSCALL_IDT_INDEX, syscall_dispatch)) {
+        klog_err(KLOG_SYSCALL, "failed to register isr %#04x\n",
+            SYSCALL_IDT_INDEX);
         return 1;
     }
 
-    klog_printf("syscall: registered isr %#2x\n", SYSCALL_IDT_INDEX);
+    klog_info(KLOG_SYSCALL, "registered isr %#04x\n", SYSCALL_IDT_INDEX);
+
+    sysenter_init();
 
     return 0;
 }
+
+u32 syscall_get_sysenter_stub(void)
+{
+    return s_sysenter ? (u32) sysenter_user_stub : 0;
+}
+
+int syscall_register(int num, syscall_fn_t fn, const char *name)
+{
+    if (num < 0 || num >= SYSCALL_MAX) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    if (s_syscalls[num].fn) {
+        klog_warn(KLOG_SYSCALL, "%d already registered as %s\n", num,
+            s_syscalls[num].name);
+        return KERROR_ARG_INVALID;
+    }
+
+    s_syscalls[num].name = name;
+    s_syscalls[num].fn = fn;
+
+    return 0;
+}
+
+static bool ptr_ok(const void *ptr, size_t len, bool from_user, bool write)
+{
+    u32 start = (u32) ptr;
+    u32 end = start + (u32) len;
+
+    if (!ptr || end < start) {
+        return false;
+    }
+
+    if (!from_user) {
+        return true;
+    }
+
+    if (start < USER_SPACE_START || end > USER_SPACE_END) {
+        return false;
+    }
+
+    // Must be mapped too: a fault on a bad pointer would take down the kernel
+    return vm_check_user(ptr, len, write);
+}
+
+bool syscall_user_ptr_ok(const void *ptr, size_t len)
+{
+    return ptr_ok(ptr, len, syscall_from_user(), false);
+}
+
+bool syscall_user_ptr_writable(const void *ptr, size_t len)
+{
+    return ptr_ok(ptr, len, syscall_from_user(), true);
+}
+
+bool syscall_ptr_ok_for(const void *ptr, size_t len, bool from_user)
+{
+    return ptr_ok(ptr, len, from_user, false);
+}
+
+bool syscall_ptr_writable_for(const void *ptr, size_t len, bool from_user)
+{
+    return ptr_ok(ptr, len, from_user, true);
+}
+
+bool syscall_from_user(void)
+{
+    return proc_current()->syscall_from_user;
+}
+
+void syscall_dump_stats(void)
+{
+    kprintf(" num  name             calls    kcycles  max cycles\n");
+
+    for (int i = 0; i < SYSCALL_MAX; ++i) {
+        const struct syscall_entry *entry = &s_syscalls[i];
+
+        if (!entry->fn) {
+            continue;
+        }
+
+        kprintf(" %3d  %-13s %8u %10u %11u\n", i, entry->name, entry->count,
+            clamp_cycles(entry->cycles >> 10), entry->max_cycles);
+    }
+
+    kprintf(" bad calls: %u\n", s_bad_calls);
+}
@@ -1,71 +1,68 @@
 #ifndef _INC_SYSCALL
 #define _INC_SYSCALL 1
 
+#include <stddef.h>
+
 #include <kernel/compiler.h>
 #include <kernel/types.h>
+#include <kernel/syscall.h>
+
+#include "isr.h"
+
+// Kernel side of the system call layer. The ABI and call numbers are in
+// <kernel/syscall.h>; both entry paths end up in syscall_dispatch().
+
+// Model-specific registers used by SYSENTER
+#define MSR_IA32_SYSENTER_CS    0x174
+#define MSR_IA32_SYSENTER_ESP   0x175
+#define MSR_IA32_SYSENTER_EIP   0x176
 
-#define SYSCALL_IDT_INDEX 0x40
-
-static ALWAYS_INLINE void __syscall(void)
-{
-    ASM_VOLATILE(
-        "int %0"::
-        "N"(SYSCALL_IDT_INDEX):
-        "cc",
-        "memory"
-    );
-}
-
-static ALWAYS_INLINE void __syscall1(u32 a)
-{
-    ASM_VOLATILE(
-        "int %0"::
-        "N"(SYSCALL_IDT_INDEX),
-        "a"(a):
-        "cc",
-        "memory"
-    );
-}
-
-static ALWAYS_INLINE void __syscall2(u32 a, u32 b)
-{
-    ASM_VOLATILE(
-        "int %0"::
-        "N"(SYSCALL_IDT_INDEX),
-        "a"(a),
-        "b"(b):
-        "cc",
-        "memory"
-    );
-}
-
-static ALWAYS_INLINE void __syscall3(u32 a, u32 b, u32 c)
-{
-    ASM_VOLATILE(
-        "int %0"::
-        "N"(SYSCALL_IDT_INDEX),
-        "a"(a),
-        "b"(b),
-        "c"(c):
-        "cc",
-        "memory"
-    );
-}
-
-static ALWAYS_INLINE void __syscall4(u32 a, u32 b, u32 c, u32 d)
-{
-    ASM_VOLATILE(
-        "int %0"::
-        "N"(SYSCALL_IDT_INDEX),
-        "a"(a),
-        "b"(b),
-        "c"(c),
-        "d"(d):
-        "cc",
-        "memory"
-    );
-}
+// User-mode entry for the SYSENTER path. Not callable from C directly, as it
+// takes its arguments in registers. Implemented in cpu/syscall.asm
+void sysenter_user_stub(void);
+
+// Kernel entry for SYSENTER. Implemented in cpu/syscall.asm
+void sysenter_entry(void);
+
+// System call implementation. Unused arguments are ignored.
+typedef u32 (*syscall_fn_t)(u32 arg1, u32 arg2, u32 arg3);
+
+// Return value of a failed system call
+#define SYSCALL_ERROR(KERROR) ((u32) -(KERROR))
 
 int syscall_init(void);
 
+// Address of the SYSENTER user stub if the fast path is enabled, else 0.
+// Published to user mode through the kernel data page.
+u32 syscall_get_sysenter_stub(void);
+
+// Installs the implementation of system call 'num'.
+int syscall_register(int num, syscall_fn_t fn, const char *name);
+
+// Checks that [ptr, ptr + len) is memory the calling context may read.
+// Kernel-mode callers may pass any non-null pointer; user-mode callers only
+// pointers to mapped user pages.
+bool syscall_user_ptr_ok(const void *ptr, size_t len);
+
+// As syscall_user_ptr_ok(), for memory the kernel will write to.
+bool syscall_user_ptr_writable(const void *ptr, size_t len);
+
+// As syscall_user_ptr_ok(), for a caller other than the current one - for
+// work done on a caller's behalf after its system call has returned. The
+// caller's address space must be loaded.
+bool syscall_ptr_ok_for(const void *ptr, size_t len, bool from_user);
+
+// As syscall_ptr_ok_for(), for memory the kernel will write to.
+bool syscall_ptr_writable_for(const void *ptr, size_t len, bool from_user);
+
+// Whether the system call being serviced came from user mode
+bool syscall_from_user(void);
+
+// Common handler for both system call paths. Called from cpu/syscall.asm and
+// the int 0x40 gate.
+void CDECL syscall_dispatch(struct isr_frame *frame);
+
+// Prints per-system-call counts and latencies.
+void syscall_dump_stats(void);
+
 #endif /* _INC_SYSCALL */
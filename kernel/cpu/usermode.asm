@@ -0,0 +1,77 @@
+[bits 32]
+
+global usermode_call
+global usermode_resume
+
+extern gdt_set_kernel_stack
+
+; Must agree with cpu/gdt.h and cpu/syscall.h
+%define USER_CODE_SELECTOR          0x1b
+%define USER_DATA_SELECTOR          0x23
+%define SYSCALL_IDT_INDEX           0x40
+%define SYS_USER_RETURN             3
+
+    [section .bss]
+
+; Kernel stack pointer saved by usermode_call(), for usermode_resume()
+saved_esp:
+    resd        1
+
+    [section .text]
+
+; u32 usermode_call(void (*fn)(void), void *stack_top)
+; Runs fn in ring 3 on the given stack. Returns once fn returns, with the
+; value passed to SYS_USER_RETURN.
+usermode_call:
+    push        ebp
+    push        ebx
+    push        esi
+    push        edi
+    pushfd
+    mov         [saved_esp], esp
+
+    ; Traps from ring 3 build their frames just below the saved state
+    push        esp
+    call        gdt_set_kernel_stack
+    add         esp, 4
+
+    mov         eax, [esp+24]                   ; fn
+    mov         ecx, [esp+28]                   ; stack_top
+
+    ; Returning from fn lands in the trampoline
+    sub         ecx, 4
+    mov         dword [ecx], usermode_return_trampoline
+
+    push        dword USER_DATA_SELECTOR        ; ss
+    push        ecx                             ; esp
+    push        dword 0x202                     ; eflags (IF)
+    push        dword USER_CODE_SELECTOR        ; cs
+    push        eax                             ; eip
+
+    mov         ax, USER_DATA_SELECTOR
+    mov         ds, ax
+    mov         es, ax
+    mov         fs, ax
+    mov         gs, ax
+    iretd
+
+; void usermode_resume(u32 result)
+; Called by the SYS_USER_RETURN handler. Discards the system call's frames
+; and returns from usermode_call() with the given result.
+usermode_resume:
+    mov         eax, [esp+4]
+    mov         esp, [saved_esp]
+    popfd
+    pop         edi
+    pop         esi
+    pop         ebx
+    pop         ebp
+    ret
+
+    [section .user_text]
+
+; Runs in ring 3 when the function passed to usermode_call() returns.
+usermode_return_trampoline:
+    mov         ebx, eax
+    mov         eax, SYS_USER_RETURN
+    int         SYSCALL_IDT_INDEX
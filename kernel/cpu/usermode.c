@@ -0,0 +1,22 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+
+#include "usermode.h"
+#include "syscall.h"
+
+static u32 sys_user_return(u32 result, u32 arg2, u32 arg3)
+{
+    (void) arg2;
+    (void) arg3;
+    usermode_resume(result);
+}
+
+int usermode_init(void)
+{
+    if (syscall_register(SYS_USER_RETURN, sys_user_return, "user_return")) {
+        klog_err(KLOG_USERMODE, "failed to register system call\n");
+        return 1;
+    }
+
+    return 0;
+}
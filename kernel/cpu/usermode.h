@@ -0,0 +1,31 @@
+#ifndef _INC_USERMODE
+#define _INC_USERMODE 1
+
+#include <kernel/compiler.h>
+#include <kernel/types.h>
+
+// Minimal support for running kernel-image code in ring 3, on the caller's
+// behalf and in the current address space - as opposed to processes (see
+// proc.h), which run separately loaded programs in their own spaces.
+//
+// Ring 3 can only reach the kernel image's .user_text and .user_data
+// sections, so the function, everything it calls, its data and its stack
+// must be placed there with USER_TEXT and USER_DATA. Note that string
+// literals land in .rodata, which ring 3 cannot read.
+
+#define USER_TEXT   SECTION(".user_text")
+#define USER_DATA   SECTION(".user_data")
+
+// Registers the SYS_USER_RETURN system call. Requires syscall_init().
+int usermode_init(void);
+
+// Runs fn in ring 3 on the stack ending at stack_top. Returns when fn
+// returns. Interrupts are enabled while fn runs.
+// Implemented in cpu/usermode.asm
+u32 CDECL usermode_call(void (*fn)(void), void *stack_top);
+
+// Returns from the active usermode_call(). Never returns.
+// Implemented in cpu/usermode.asm
+NO_RETURN void CDECL usermode_resume(u32 result);
+
+#endif /* _INC_USERMODE */
@@ -0,0 +1,90 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/kerror.h>
+
+#include "elf.h"
+#include "mem/page.h"
+
+static bool is_valid_header(const struct elf32_header *header, size_t size)
+{
+    u32 ph_end;
+
+    if (size < sizeof(*header) ||
+            *(const u32 *) header->e_ident != ELF_MAGIC ||
+            header->e_ident[ELF_IDENT_CLASS] != ELF_CLASS_32 ||
+            header->e_ident[ELF_IDENT_DATA] != ELF_DATA_LSB ||
+            header->e_ident[ELF_IDENT_VERSION] != ELF_VERSION_CURRENT ||
+            header->e_type != ELF_TYPE_EXEC ||
+            header->e_machine != ELF_MACHINE_386 ||
+            header->e_version != ELF_VERSION_CURRENT) {
+        return false;
+    }
+
+    if (header->e_phentsize != sizeof(struct elf32_program_header) ||
+            !header->e_phnum) {
+        return false;
+    }
+
+    ph_end = header->e_phoff + header->e_phnum * header->e_phentsize;
+    return ph_end > header->e_phoff && ph_end <= size;
+}
+
+static int load_segment(struct vm_space *space, const u8 *image, size_t size,
+    const struct elf32_program_header *ph)
+{
+    u32 start = ph->p_vaddr & ~(PAGE_SIZE - 1);
+    u32 end = (ph->p_vaddr + ph->p_memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    if (ph->p_filesz > ph->p_memsz ||
+            ph->p_offset + ph->p_filesz < ph->p_offset ||
+            ph->p_offset + ph->p_filesz > size ||
+            ph->p_vaddr + ph->p_memsz < ph->p_vaddr) {
+        return KERROR_ARG_INVALID;
+    }
+
+    if (!ph->p_memsz) {
+        return 0;
+    }
+
+    return vm_add_region(space, start, end,
+        (ph->p_flags & ELF_PF_W) ? VM_WRITE : 0,
+        image + ph->p_offset, ph->p_vaddr, ph->p_filesz);
+}
+
+int elf_load(struct vm_space *space, const void *image, size_t size,
+    u32 *entry)
+{
+    const struct elf32_header *header = image;
+    const struct elf32_program_header *ph;
+    int loaded = 0;
+
+    if (!image || !is_valid_header(header, size)) {
+        return KERROR_ARG_INVALID;
+    }
+
+    ph = (const struct elf32_program_header *)
+        ((const u8 *) image + header->e_phoff);
+
+    for (u16 i = 0; i < header->e_phnum; ++i, ++ph) {
+        int result;
+
+        if (ph->p_type != ELF_PT_LOAD) {
+            continue;
+        }
+
+        result = load_segment(space, image, size, ph);
+        if (result) {
+            klog_warn(KLOG_ELF, "bad segment %d at %p\n", i,
+                (void *) ph->p_vaddr);
+            return result;
+        }
+        ++loaded;
+    }
+
+    if (!loaded) {
+        return KERROR_ARG_INVALID;
+    }
+
+    *entry = header->e_entry;
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _INC_ELF
+#define _INC_ELF 1
+
+#include <stddef.h>
+
+#include <kernel/types.h>
+
+#include "mem/vm.h"
+
+// ELF32 executables, as produced by 'ld -m elf_i386'.
+// Reference: Tool Interface Standard (TIS) ELF Specification, version 1.2
+
+#define ELF_MAGIC           0x464c457f  // "\x7f" "ELF", read little-endian
+
+// e_ident indices and values
+#define ELF_IDENT_CLASS     4
+#define ELF_IDENT_DATA      5
+#define ELF_IDENT_VERSION   6
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+
+#define ELF_TYPE_EXEC       2
+#define ELF_MACHINE_386     3
+#define ELF_VERSION_CURRENT 1
+
+// Program header types and flags
+#define ELF_PT_LOAD         1
+#define ELF_PF_X            0x1
+#define ELF_PF_W            0x2
+#define ELF_PF_R            0x4
+
+struct elf32_header {
+    u8  e_ident[16];
+    u16 e_type;
+    u16 e_machine;
+    u32 e_version;
+    u32 e_entry;
+    u32 e_phoff;
+    u32 e_shoff;
+    u32 e_flags;
+    u16 e_ehsize;
+    u16 e_phentsize;
+    u16 e_phnum;
+    u16 e_shentsize;
+    u16 e_shnum;
+    u16 e_shstrndx;
+};
+
+struct elf32_program_header {
+    u32 p_type;
+    u32 p_offset;
+    u32 p_vaddr;
+    u32 p_paddr;
+    u32 p_filesz;
+    u32 p_memsz;
+    u32 p_flags;
+    u32 p_align;
+};
+
+// Sets up the PT_LOAD segments of an executable as demand-paged regions of
+// 'space' - nothing is copied until a page is first touched, and the part
+// of each segment past its file data (.bss) is zero-filled. The image is
+// used as the backing store, so it must outlive the address space.
+int elf_load(struct vm_space *space, const void *image, size_t size,
+    u32 *entry);
+
+#endif /* _INC_ELF */
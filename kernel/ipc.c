@@ -0,0 +1,308 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/kerror.h>
+#include <kernel/syscall.h>
+#include <kernel/asm/misc.h>
+
+#include "ipc.h"
+#include "proc.h"
+#include "uring.h"
+#include "cpu/syscall.h"
+#include "mem/vm.h"
+
+// All of this runs in system calls, with interrupts disabled, so the only
+// way state changes under us is by blocking.
+
+struct ipc_endpoint {
+    struct process  *server;        // Null if the slot is free
+    struct process  *receiver;      // Server, while blocked in recv
+    struct process  *queue_head;    // Callers waiting to be received
+    struct process  *queue_tail;
+    struct process  *replying_to;   // Caller being served
+};
+
+static struct ipc_endpoint s_endpoints[IPC_MAX_ENDPOINTS];
+
+static struct ipc_endpoint *get_endpoint(u32 id)
+{
+    if (id >= IPC_MAX_ENDPOINTS || !s_endpoints[id].server) {
+        return NULL;
+    }
+    return &s_endpoints[id];
+}
+
+static bool is_valid_grant(u32 grant)
+{
+    u32 pages = IPC_GRANT_PAGES(grant);
+    return !grant || (pages && pages <= IPC_MAX_GRANT_PAGES);
+}
+
+// Pages behind a registered ring can't be given away; the kernel polls the
+// ring from the timer and would find it gone.
+static bool is_movable_grant(const struct process *p, u32 grant)
+{
+    return !uring_in_range(p, IPC_GRANT_ADDR(grant),
+        IPC_GRANT_PAGES(grant) * PAGE_SIZE);
+}
+
+static void enqueue(struct ipc_endpoint *ep, struct process *caller)
+{
+    caller->ipc_next = NULL;
+    if (ep->queue_tail) {
+        ep->queue_tail->ipc_next = caller;
+    } else {
+        ep->queue_head = caller;
+    }
+    ep->queue_tail = caller;
+}
+
+static struct process *dequeue(struct ipc_endpoint *ep)
+{
+    struct process *caller = ep->queue_head;
+
+    if (caller) {
+        ep->queue_head = caller->ipc_next;
+        if (!ep->queue_head) {
+            ep->queue_tail = NULL;
+        }
+        caller->ipc_next = NULL;
+    }
+
+    return caller;
+}
+
+static void unlink_caller(struct ipc_endpoint *ep, struct process *caller)
+{
+    struct process **link = &ep->queue_head;
+
+    ep->queue_tail = NULL;
+    while (*link) {
+        if (*link == caller) {
+            *link = caller->ipc_next;
+            continue;
+        }
+        ep->queue_tail = *link;
+        link = &(*link)->ipc_next;
+    }
+}
+
+// Ends a call without a reply
+static void fail_call(struct process *caller, int error)
+{
+    caller->ipc_result = SYSCALL_ERROR(error);
+    proc_wake(caller);
+}
+
+static void destroy(struct ipc_endpoint *ep)
+{
+    struct process *caller;
+
+    while ((caller = dequeue(ep))) {
+        fail_call(caller, KERROR_ARG_INVALID);
+    }
+    if (ep->replying_to) {
+        fail_call(ep->replying_to, KERROR_ARG_INVALID);
+    }
+
+    KZEROMEM(ep, sizeof(*ep));
+}
+
+void ipc_release_process(struct process *p)
+{
+    for (int i = 0; i < IPC_MAX_ENDPOINTS; ++i) {
+        struct ipc_endpoint *ep = &s_endpoints[i];
+
+        if (!ep->server) {
+            continue;
+        }
+
+        if (ep->server == p) {
+            destroy(ep);
+            continue;
+        }
+
+        unlink_caller(ep, p);
+        if (ep->replying_to == p) {
+            ep->replying_to = NULL;
+        }
+    }
+}
+
+static u32 sys_ipc_create(u32 arg1, u32 arg2, u32 arg3)
+{
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+
+    if (!syscall_from_user()) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    for (u32 i = 0; i < IPC_MAX_ENDPOINTS; ++i) {
+        if (!s_endpoints[i].server) {
+            KZEROMEM(&s_endpoints[i], sizeof(s_endpoints[i]));
+            s_endpoints[i].server = proc_current();
+            return i;
+        }
+    }
+
+    return SYSCALL_ERROR(KERROR_LIMIT_EXCEEDED);
+}
+
+static u32 sys_ipc_destroy(u32 id, u32 arg2, u32 arg3)
+{
+    struct ipc_endpoint *ep = get_endpoint(id);
+
+    (void) arg2;
+    (void) arg3;
+
+    if (!ep || ep->server != proc_current()) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    destroy(ep);
+    return 0;
+}
+
+static u32 sys_ipc_call(u32 id, u32 word, u32 grant)
+{
+    struct ipc_endpoint *ep = get_endpoint(id);
+    struct process *caller = proc_current();
+
+    if (!ep || ep->server == caller || !syscall_from_user() ||
+            !is_valid_grant(grant)) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    // Fault in any untouched pages now, so that they can be moved later
+    if (grant && !syscall_user_ptr_ok((const void *) IPC_GRANT_ADDR(grant),
+            IPC_GRANT_PAGES(grant) * PAGE_SIZE)) {
+        return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    if (grant && !is_movable_grant(caller, grant)) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    caller->ipc_word = word;
+    caller->ipc_grant = grant;
+    caller->ipc_result = SYSCALL_ERROR(KERROR_UNSPECIFIED);
+    enqueue(ep, caller);
+
+    if (ep->receiver) {
+        proc_wake(ep->receiver);
+        ep->receiver = NULL;
+    }
+
+    // Until the reply, or until the endpoint goes away
+    proc_block();
+
+    return caller->ipc_result;
+}
+
+static u32 sys_ipc_recv(u32 id, u32 msg_addr, u32 window)
+{
+    struct ipc_endpoint *ep = get_endpoint(id);
+    struct process *server = proc_current();
+    struct ipc_message *msg = (struct ipc_message *) msg_addr;
+    struct process *caller;
+    u32 pages = 0;
+
+    if (!ep || ep->server != server || ep->replying_to ||
+            (window & (PAGE_SIZE - 1))) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    if (!syscall_user_ptr_writable(msg, sizeof(*msg))) {
+        return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    while (!ep->queue_head) {
+        ep->receiver = server;
+        proc_block();
+
+        // The endpoint can't be destroyed while we're its server
+    }
+
+    caller = dequeue(ep);
+
+    // The grant was checked at the call, and the caller has been blocked
+    // since, so it can't have registered a ring in the meantime.
+    if (caller->ipc_grant && window) {
+        pages = IPC_GRANT_PAGES(caller->ipc_grant);
+        if (vm_move_pages(server->space, window, caller->space,
+                IPC_GRANT_ADDR(caller->ipc_grant), pages)) {
+            pages = 0;
+        }
+    }
+
+    // Checked before blocking; nothing else could change this space since
+    msg->word = caller->ipc_word;
+    msg->pages = pages;
+    msg->sender = caller->pid;
+
+    ep->replying_to = caller;
+    return 0;
+}
+
+static u32 sys_ipc_reply(u32 id, u32 word, u32 grant)
+{
+    struct ipc_endpoint *ep = get_endpoint(id);
+    struct process *server = proc_current();
+    struct process *caller;
+    int result = 0;
+
+    if (!ep || ep->server != server || !is_valid_grant(grant)) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    // The caller may have gone away; the reply then goes nowhere
+    caller = ep->replying_to;
+    ep->replying_to = NULL;
+    if (!caller) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    // Pages go back to where the caller's grant came from
+    if (grant) {
+        if (!syscall_user_ptr_ok((const void *) IPC_GRANT_ADDR(grant),
+                IPC_GRANT_PAGES(grant) * PAGE_SIZE)) {
+            result = KERROR_BAD_ADDRESS;
+        } else if (IPC_GRANT_PAGES(grant) >
+                IPC_GRANT_PAGES(caller->ipc_grant)) {
+            result = KERROR_ARG_OUT_OF_RANGE;
+        } else if (!is_movable_grant(server, grant)) {
+            result = KERROR_ARG_INVALID;
+        } else {
+            result = vm_move_pages(caller->space,
+                IPC_GRANT_ADDR(caller->ipc_grant), server->space,
+                IPC_GRANT_ADDR(grant), IPC_GRANT_PAGES(grant));
+        }
+    }
+
+    caller->ipc_result = word;
+    proc_wake(caller);
+
+    return result ? SYSCALL_ERROR(result) : 0;
+}
+
+int ipc_init(void)
+{
+    int result = 0;
+
+    KZEROMEM(s_endpoints, sizeof(s_endpoints));
+
+    result |= syscall_register(SYS_IPC_CREATE, sys_ipc_create, "ipc_create");
+    result |= syscall_register(SYS_IPC_DESTROY, sys_ipc_destroy, "ipc_destroy");
+    result |= syscall_register(SYS_IPC_CALL, sys_ipc_call, "ipc_call");
+    result |= syscall_register(SYS_IPC_RECV, sys_ipc_recv, "ipc_recv");
+    result |= syscall_register(SYS_IPC_REPLY, sys_ipc_reply, "ipc_reply");
+
+    if (result) {
+        klog_err(KLOG_IPC, "init failed\n");
+        return 1;
+    }
+
+    klog_info(KLOG_IPC, "%d endpoints\n", IPC_MAX_ENDPOINTS);
+    return 0;
+}
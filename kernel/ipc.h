@@ -0,0 +1,20 @@
+#ifndef _INC_IPC
+#define _INC_IPC 1
+
+#include <kernel/ipc.h>
+
+// Kernel side of IPC endpoints (see <kernel/ipc.h>).
+
+// Most endpoints at once
+#define IPC_MAX_ENDPOINTS       16
+
+struct process;
+
+// Registers the IPC system calls. Requires syscall_init() and proc_init().
+int ipc_init(void);
+
+// Destroys p's endpoints and takes p out of any calls in progress. Called
+// when p exits.
+void ipc_release_process(struct process *p);
+
+#endif /* _INC_IPC */
@@ -1,107 +1,155 @@
 #include <kernel/kernel.h>
 #include <kernel/klog.h>
+#include <kernel/asm/misc.h>
 
 #include "irq.h"
+#include "kio.h"
 #include "cpu/isr.h"
 #include "pic.h"
 
 // Reference for IRQs' respective devices:
 // https://en.wikipedia.org/wiki/Interrupt_request_(PC_architecture)
 
-static irq_hook_t irq_hooks[16];
+// A hook on an IRQ line, along with its accounting. Hooks on the same line
+// form a singly-linked chain, called in the order they were added.
+struct irq_action {
+    irq_hook_t          hookfn;
+    const char          *name;
+    struct irq_action   *next;
+    u32                 count;      // Times called
+    u32                 handled;    // Times it claimed the interrupt
+    u64                 cycles;     // Cumulative TSC cycles spent in hookfn
+};
+
+struct irq_line {
+    struct irq_action   *actions;
+    u32                 count;      // Times the line was raised
+    u32                 spurious;   // Raised, but claimed by no hook
+    u64                 cycles;     // Cumulative TSC cycles spent in hooks
+};
+
+// Chain nodes are handed out from a fixed pool until we have a heap that
+// can free.
+static struct irq_action s_action_pool[IRQ_HOOK_POOL_SIZE];
+static struct irq_line s_lines[IRQ_COUNT];
 
-#define DEFAULT_HOOK_FUNC __irq_default_hook_func
+static INLINE int __irq_is_valid_irqnum_impl(int irqnum)
+{
+    return !((irqnum < 0) || (irqnum >= (int) ARRLEN(s_lines)));
+}
 
-static int DEFAULT_HOOK_FUNC(int irqnum)
+static INLINE int __irq_has_hook_impl(int irqnum)
 {
-    // Should irq_done(irqnum) be called for the default handler and/or
-    // make this an option, e.g. irq_auto_dismiss_unhooked(int)?
-    (void) irqnum;
-    return 0;
+    return (s_lines[irqnum].actions != NULL);
 }
 
-static INLINE int __irq_is_valid_irqnum_impl(int irqnum)
+static int __irq_call_hook_impl(int irqnum)
 {
-    return !((irqnum < 0) || (irqnum >= (int) ARRLEN(irq_hooks)));
+    struct irq_line *line = &s_lines[irqnum];
+    int handled = 0;
+
+    ++line->count;
+
+    for (struct irq_action *action = line->actions; action;
+        action = action->next) {
+
+        u64 start = rdtsc();
+        int result = action->hookfn(irqnum);
+        u64 elapsed = rdtsc() - start;
+
+        ++action->count;
+        action->cycles += elapsed;
+        line->cycles += elapsed;
+
+        if (result == IRQ_HANDLED) {
+            ++action->handled;
+            handled = 1;
+        }
+    }
+
+    if (!handled) {
+        ++line->spurious;
+    }
+
+    return handled ? IRQ_HANDLED : IRQ_NOT_HANDLED;
 }
 
-static INLINE int __irq_has_hook_impl(int irqnum)
+// IRQs 7 and 15 are raised by the PIC itself if the real request went away
+// before it could be acknowledged. In that case the ISR bit is clear and the
+// PIC that raised it must not be sent an EOI.
+static INLINE int __irq_is_pic_spurious(int irqnum)
 {
-    return (irq_hooks[irqnum] != DEFAULT_HOOK_FUNC);
+    if ((irqnum & 7) != 7) {
+        return 0;
+    }
+
+    return !(pic_get_isr() & (1 << irqnum));
 }
 
-static INLINE int __irq_call_hook_impl(int irqnum)
+// Common ISR handler for all PIC IRQ vectors
+static void irq_isr_handler(struct isr_frame *frame)
 {
-    return (irq_hooks[irqnum](irqnum));
+    int irqnum = (int) frame->vector - IRQ_PIC_MASTER_IDT_OFFSET;
+
+    if (irqnum >= 8) {
+        irqnum = (int) frame->vector - IRQ_PIC_SLAVE_IDT_OFFSET + 8;
+    }
+
+    if (__irq_is_pic_spurious(irqnum)) {
+        ++s_lines[irqnum].spurious;
+
+        // The master did see a real request from the slave's cascade line.
+        if (irqnum == 15) {
+            pic_end_of_interrupt(0);
+        }
+
+        return;
+    }
+
+    __irq_call_hook_impl(irqnum);
+    pic_end_of_interrupt(irqnum);
 }
 
-#define IRQ_ISR_HANDLER(IRQNUM)     ISR_HANDLER(irq_##IRQNUM)
-
-#define IRQ_DEF_ISR_HANDLER(IRQNUM)                 \
-    __ISR_HOOK_HANDLER_BASE(IRQ_ISR_HANDLER(IRQNUM),\
-    {                                               \
-        __irq_call_hook_impl(IRQNUM);               \
-    });
-
-static IRQ_DEF_ISR_HANDLER(0);
-static IRQ_DEF_ISR_HANDLER(1);
-static IRQ_DEF_ISR_HANDLER(2);
-static IRQ_DEF_ISR_HANDLER(3);
-static IRQ_DEF_ISR_HANDLER(4);
-static IRQ_DEF_ISR_HANDLER(5);
-static IRQ_DEF_ISR_HANDLER(6);
-static IRQ_DEF_ISR_HANDLER(7);
-
-static IRQ_DEF_ISR_HANDLER(8);
-static IRQ_DEF_ISR_HANDLER(9);
-static IRQ_DEF_ISR_HANDLER(10);
-static IRQ_DEF_ISR_HANDLER(11);
-static IRQ_DEF_ISR_HANDLER(12);
-static IRQ_DEF_ISR_HANDLER(13);
-static IRQ_DEF_ISR_HANDLER(14);
-static IRQ_DEF_ISR_HANDLER(15);
+static struct irq_action *alloc_action(void)
+{
+    for (size_t i = 0; i < ARRLEN(s_action_pool); ++i) {
+        if (!s_action_pool[i].hookfn) {
+            return &s_action_pool[i];
+        }
+    }
+
+    return NULL;
+}
 
 int irq_init(void)
 {
     int res = 0;
 
-    klog_printf("irq: remapping pic\n");
+    klog_info(KLOG_IRQ, "remapping pic\n");
     if (pic_remap(IRQ_PIC_MASTER_IDT_OFFSET, IRQ_PIC_SLAVE_IDT_OFFSET)) {
-        klog_printf("irq: irq init failed\n");
+        klog_err(KLOG_IRQ, "irq init failed\n");
         return 1;
     }
 
-    // Set all hooks to the default hook function
-    for (size_t i = 0; i < 16; ++i) {
-        irq_hooks[i] = DEFAULT_HOOK_FUNC;
-    }
+    KZEROMEM(s_action_pool, sizeof(s_action_pool));
+    KZEROMEM(s_lines, sizeof(s_lines));
 
     // PIC Master IRQs
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 0, IRQ_ISR_HANDLER(0));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 1, IRQ_ISR_HANDLER(1));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 2, IRQ_ISR_HANDLER(2));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 3, IRQ_ISR_HANDLER(3));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 4, IRQ_ISR_HANDLER(4));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 5, IRQ_ISR_HANDLER(5));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 6, IRQ_ISR_HANDLER(6));
-    res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + 7, IRQ_ISR_HANDLER(7));
+    for (int i = 0; i < 8; ++i) {
+        res |= isr_set_handler(IRQ_PIC_MASTER_IDT_OFFSET + i, irq_isr_handler);
+    }
 
     // PIC Slave IRQs
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 0, IRQ_ISR_HANDLER(8));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 1, IRQ_ISR_HANDLER(9));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 2, IRQ_ISR_HANDLER(10));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 3, IRQ_ISR_HANDLER(11));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 4, IRQ_ISR_HANDLER(12));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 5, IRQ_ISR_HANDLER(13));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 6, IRQ_ISR_HANDLER(14));
-    res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + 7, IRQ_ISR_HANDLER(15));
+    for (int i = 0; i < 8; ++i) {
+        res |= isr_set_handler(IRQ_PIC_SLAVE_IDT_OFFSET + i, irq_isr_handler);
+    }
 
     if (res) {
-        klog_printf("irq: failed to register one or more irq isr handlers\n");
+        klog_err(KLOG_IRQ, "failed to register one or more irq isr handlers\n");
         return 1;
     }
 
-    klog_printf("irq: registered irq isr handlers\n");
+    klog_info(KLOG_IRQ, "registered irq isr handlers\n");
     return 0;
 }
 
@@ -119,45 +167,70 @@ int irq_has_hook(int irqnum)
     }
 }
 
-int irq_set_hook(int irqnum, irq_hook_t hookfn)
+int irq_add_hook(int irqnum, irq_hook_t hookfn, const char *name)
 {
-    // Is the irqnum valid?
-    if (__irq_is_valid_irqnum_impl(irqnum)) {
-        // Is there already a hook for this irqnum?
-        if (!__irq_has_hook_impl(irqnum)) {
-            // Set the hook function
-            irq_hooks[irqnum] = hookfn;
+    struct irq_action *action;
+    struct irq_action **link;
 
-            // Enable the IRQ on the PIC
-            pic_set_enabled(irqnum, 1);
+    if (!__irq_is_valid_irqnum_impl(irqnum) || !hookfn) {
+        klog_warn(KLOG_IRQ, "%d is an invalid irq number\n", irqnum);
+        return 1;
+    }
 
-            klog_printf("irq: irq %d hooked at %p\n", irqnum, (void *) hookfn);
+    action = alloc_action();
+    if (!action) {
+        klog_warn(KLOG_IRQ, "cannot hook irq %d at %p, limit of %d reached\n",
+            irqnum, (void *) hookfn, IRQ_HOOK_POOL_SIZE);
+        return 1;
+    }
 
-            return 0;
-        } else {
-            // Already a hook
-            klog_printf("irq: irq %d already hooked at %p\n", irqnum,
-                (void *) irq_hooks[irqnum]);
-    	}
-    } else {
-        // Invalid irqnum
-        klog_printf("irq: %d is an invalid irq number\n", irqnum);
+    action->hookfn = hookfn;
+    action->name = name ? name : "?";
+    action->next = NULL;
+    action->count = 0;
+    action->handled = 0;
+    action->cycles = 0;
+
+    // Append to the chain. The node is complete before it becomes reachable,
+    // so an IRQ arriving part-way through sees either the old or new chain.
+    link = &s_lines[irqnum].actions;
+    while (*link) {
+        link = &(*link)->next;
     }
+    *link = action;
 
-    klog_printf("irq: failed to hook irq %d at %p\n", irqnum, (void *) hookfn);
+    // Enable the IRQ on the PIC when the first hook arrives
+    if (link == &s_lines[irqnum].actions) {
+        pic_set_enabled(irqnum, 1);
+    }
 
-    return 1;
+    klog_debug(KLOG_IRQ, "irq %d hooked at %p (%s)\n", irqnum, (void *) hookfn,
+        action->name);
+
+    return 0;
 }
 
-int irq_remove_hook(int irqnum)
+int irq_remove_hook(int irqnum, irq_hook_t hookfn)
 {
-    if (__irq_is_valid_irqnum_impl(irqnum)) {
-        if (__irq_has_hook_impl(irqnum)) {
-            irq_hook_t old_hook = irq_hooks[irqnum];
-            irq_hooks[irqnum] = DEFAULT_HOOK_FUNC;
-            pic_set_enabled(irqnum, 0);
-            klog_printf("irq: irq %d unhooked from %p\n", irqnum,
-                (void *) old_hook);
+    struct irq_action **link;
+
+    if (!__irq_is_valid_irqnum_impl(irqnum)) {
+        return 1;
+    }
+
+    for (link = &s_lines[irqnum].actions; *link; link = &(*link)->next) {
+        struct irq_action *action = *link;
+
+        if (action->hookfn == hookfn) {
+            *link = action->next;
+            action->hookfn = NULL;
+
+            if (!__irq_has_hook_impl(irqnum)) {
+                pic_set_enabled(irqnum, 0);
+            }
+
+            klog_debug(KLOG_IRQ, "irq %d unhooked from %p\n", irqnum,
+                (void *) hookfn);
             return 0;
         }
     }
@@ -171,7 +244,7 @@ int irq_call_hook(int irqnum)
         return __irq_call_hook_impl(irqnum);
     }
 
-    return 1;
+    return IRQ_NOT_HANDLED;
 }
 
 int irq_done(int irqnum)
@@ -179,3 +252,28 @@ int irq_done(int irqnum)
     pic_end_of_interrupt(irqnum);
     return 0;
 }
+
+void irq_dump_stats(void)
+{
+    // Cycle counts are shown in units of 1024 cycles, to keep them in 32 bits
+    kprintf(" irq      count   spurious   kcycles  hooks\n");
+
+    for (int i = 0; i < (int) ARRLEN(s_lines); ++i) {
+        const struct irq_line *line = &s_lines[i];
+
+        if (!line->actions && !line->count && !line->spurious) {
+            continue;
+        }
+
+        kprintf(" %3d %10u %10u %9u ", i, line->count, line->spurious,
+            (u32) (line->cycles >> 10));
+
+        for (const struct irq_action *action = line->actions; action;
+            action = action->next) {
+            kprintf(" %s(%u/%u, %uk)", action->name, action->handled,
+                action->count, (u32) (action->cycles >> 10));
+        }
+
+        kprintf("\n");
+    }
+}
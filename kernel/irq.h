@@ -4,15 +4,33 @@
 #define IRQ_PIC_MASTER_IDT_OFFSET   0x20
 #define IRQ_PIC_SLAVE_IDT_OFFSET    0x28
 
+#define IRQ_COUNT                   16
+
+// Maximum number of hooks across all IRQ lines
+#define IRQ_HOOK_POOL_SIZE          32
+
+// Hook return values. Several hooks may share one IRQ line; each is called in
+// turn and must report whether its device actually raised the interrupt.
+enum {
+    IRQ_NOT_HANDLED = 0,
+    IRQ_HANDLED     = 1,
+};
+
+// Hooks must not send the end-of-interrupt themselves - the IRQ dispatcher
+// does that once the whole chain has run.
 typedef int (*irq_hook_t)(int irqnum);
 
 int irq_init(void);
 int irq_is_valid_irqnum(int irqnum);
 int irq_has_hook(int irqnum);
-int irq_set_hook(int irqnum, irq_hook_t hookfn);
-int irq_remove_hook(int irqnum);
+int irq_add_hook(int irqnum, irq_hook_t hookfn, const char *name);
+int irq_remove_hook(int irqnum, irq_hook_t hookfn);
 int irq_call_hook(int irqnum);
 int irq_set_enabled(int irqnum, int enabled);
 int irq_done(int irqnum);
 
+// Prints per-IRQ and per-hook invocation, spurious and cycle counters, in the
+// spirit of /proc/interrupts.
+void irq_dump_stats(void);
+
 #endif /* _INC_IRQ */
@@ -0,0 +1,120 @@
+#include <kernel/kernel.h>
+#include <kernel/irqtrace.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpustat.h>
+
+#include "kio.h"
+#include "cpu/idt.h"
+
+#if IRQ_TRACE
+
+struct vector_trace {
+    u32 count;
+    u32 max_cycles;
+    u32 buckets[IRQTRACE_BUCKETS];
+};
+
+static struct vector_trace s_vectors[IDT_MAX];
+
+// The currently open interrupts-disabled section, if cli() opened one
+static u64 s_off_start;
+static void *s_off_caller;
+
+// The longest interrupts-disabled section seen so far
+static u32 s_off_max_cycles;
+static void *s_off_max_cli_site;
+static void *s_off_max_sti_site;
+
+static INLINE u32 clamp_cycles(u64 cycles)
+{
+    return (cycles > 0xffffffffULL) ? 0xffffffff : (u32) cycles;
+}
+
+// Bucket 0 holds durations below 2^IRQTRACE_MIN_SHIFT cycles. Bucket n holds
+// durations in [2^(IRQTRACE_MIN_SHIFT + n - 1), 2^(IRQTRACE_MIN_SHIFT + n)).
+static INLINE int cycles_bucket(u32 cycles)
+{
+    int bucket;
+
+    if (cycles < (1u << IRQTRACE_MIN_SHIFT)) {
+        return 0;
+    }
+
+    bucket = 32 - __builtin_clz(cycles) - IRQTRACE_MIN_SHIFT;
+    return MIN(bucket, IRQTRACE_BUCKETS - 1);
+}
+
+// These are called from inlined cli()/sti(), so the return address is the
+// site of the cli()/sti() itself.
+void NO_INLINE irqtrace_irqs_disabling(void)
+{
+    // Only a transition from enabled to disabled opens a section
+    if (get_eflags() & EFLAGS_IF) {
+        s_off_start = rdtsc();
+        s_off_caller = __builtin_return_address(0);
+    }
+}
+
+void NO_INLINE irqtrace_irqs_enabling(void)
+{
+    u32 cycles;
+
+    if (!s_off_caller) {
+        return;
+    }
+
+    cycles = clamp_cycles(rdtsc() - s_off_start);
+
+    if (cycles > s_off_max_cycles) {
+        s_off_max_cycles = cycles;
+        s_off_max_cli_site = s_off_caller;
+        s_off_max_sti_site = __builtin_return_address(0);
+    }
+
+    s_off_caller = NULL;
+}
+
+void irqtrace_isr_exit(u32 vector, u64 start_tsc)
+{
+    struct vector_trace *trace = &s_vectors[vector & (IDT_MAX - 1)];
+    u32 cycles = clamp_cycles(rdtsc() - start_tsc);
+
+    ++trace->count;
+    trace->max_cycles = MAX(trace->max_cycles, cycles);
+    ++trace->buckets[cycles_bucket(cycles)];
+}
+
+void irqtrace_dump(void)
+{
+    kprintf("irqtrace: longest irqs-off section %u cycles (cli %p, sti %p)\n",
+        s_off_max_cycles, s_off_max_cli_site, s_off_max_sti_site);
+    kprintf("irqtrace: isr durations, log2(cycles):count\n");
+
+    for (int i = 0; i < IDT_MAX; ++i) {
+        const struct vector_trace *trace = &s_vectors[i];
+
+        if (!trace->count) {
+            continue;
+        }
+
+        kprintf(" %#04x n=%u max=%u", i, trace->count, trace->max_cycles);
+
+        for (int b = 0; b < IRQTRACE_BUCKETS; ++b) {
+            if (trace->buckets[b]) {
+                kprintf(" %s%d:%u", b ? "" : "<", IRQTRACE_MIN_SHIFT + b - !!b,
+                    trace->buckets[b]);
+            }
+        }
+
+        kprintf("\n");
+    }
+}
+
+#else /* IRQ_TRACE */
+
+void irqtrace_dump(void)
+{
+    kprintf("irqtrace: not built in (build with IRQ_TRACE=1)\n");
+}
+
+#endif /* IRQ_TRACE */
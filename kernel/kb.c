@@ -67,7 +67,7 @@ static int poll_ps2(struct ps2_kb_packet *buffer, int buffer_size)
     while (true) {
         // If the buffer size is reached, don't process any more packets.
         if (i > buffer_size) {
-            klog_printf("kb: ps2 poll packet buffer full (%d packets)\n",
+            klog_warn(KLOG_KB, "ps2 poll packet buffer full (%d packets)\n",
                 buffer_size);
             FLUSH_INPUT_BUFFER();
             return -1;
@@ -134,20 +134,20 @@ int kb_irq_hook(int irqnum) {
         call_listeners(&key);
     }
 
-    irq_done(irqnum);
-    return 0;
+    (void) irqnum;
+    return num_received ? IRQ_HANDLED : IRQ_NOT_HANDLED;
 }
 
 int kb_init(void)
 {
     KZEROMEM(s_listener_func_list, sizeof(s_listener_func_list));
 
-    if (irq_set_hook(1, kb_irq_hook)) {
-        klog_printf("kb: failed to hook irq\n");
+    if (irq_add_hook(1, kb_irq_hook, "kb")) {
+        klog_err(KLOG_KB, "failed to hook irq\n");
         return 1;
     }
 
-    klog_printf("kb: irq hooked\n");
+    klog_debug(KLOG_KB, "irq hooked\n");
 
     ps2_set_enabled(1, 1);
 
@@ -184,7 +184,7 @@ int kb_set_typematic_config(int repeat_rate, int typematic_delay)
         return KERROR_HARDWARE_PORT;
     }
 
-    klog_printf("kb: set repeat rate to %#02x, typematic delay to %d\n",
+    klog_debug(KLOG_KB, "set repeat rate to %#04x, typematic delay to %d\n",
         repeat_rate, typematic_delay);
 
     return 0;
@@ -205,7 +205,7 @@ int kb_add_listener(kb_listener_func func)
         }
     }
 
-    klog_printf("kb: cannot add listener at %p, limit of %d reached\n",
+    klog_warn(KLOG_KB, "cannot add listener at %p, limit of %d reached\n",
         func, KB_LISTENER_FUNC_LIST_SIZE);
 
     return KERROR_LIMIT_EXCEEDED;
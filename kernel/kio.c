@@ -2,94 +2,180 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <ctype.h>
+#include <string.h>
 
 #include <kernel/kernel.h>
 #include <kernel/compiler.h>
+#include <kernel/klog.h>
+#include <kernel/asm/misc.h>
 
 #include "kio.h"
 #include "con.h"
+#include "serial.h"
 
-#define OUTBUF_SIZE PAGE_SIZE
+// Runs of padding, handed to sinks a chunk at a time
+#define PAD_CHUNK           16
 
-static PAGE_ALIGNED char s_outbuf[OUTBUF_SIZE];
-static int s_outbuf_zeroed = 0;
+static const char s_pad_spaces[PAD_CHUNK] = "                ";
+static const char s_pad_zeros[PAD_CHUNK] = "0000000000000000";
 
-extern int con_write_str(const char *);
-extern int con_write_char(char);
+// Hands 'len' chars of 'str' to the sink, returning 'len'
+static INLINE size_t sink_put(struct kio_sink *sink, const char *str,
+    size_t len)
+{
+    if (len) {
+        sink->put(sink, str, len);
+    }
+    return len;
+}
 
-size_t __sputs(char **dst, const char *src, size_t sz)
+// Hands 'count' copies of ' ' or '0' to the sink, returning 'count'
+static size_t sink_pad(struct kio_sink *sink, const char *pad, size_t count)
 {
-    size_t i = 0;
+    size_t left = count;
 
-    while (*src) {
-        **dst = *src;
-        ++i;
-        if (!--sz) {
-            **dst = 0;
-            break;
-        }
-        src++;
-        (*dst)++;
+    while (left > PAD_CHUNK) {
+        sink->put(sink, pad, PAD_CHUNK);
+        left -= PAD_CHUNK;
     }
+    sink_put(sink, pad, left);
 
-    return i;
+    return count;
 }
 
-size_t __itoa10(int val, char *dst)
+static void buf_sink_put(struct kio_sink *sink, const char *str, size_t len)
 {
-    int buf[10];
-    size_t i = 0;
-    size_t count;
-    int is_negative = 0;
+    struct kio_buf_sink *bs = (struct kio_buf_sink *) sink;
+    size_t room = bs->size ? bs->size - 1 - bs->len : 0;
 
-    if (val < 0) {
-        is_negative = 1;
-        val = -val;
+    if (len > room) {
+        len = room;
     }
 
-    while (i < ARRLEN(buf)) {
-        buf[i++] = val % 10;
-        val /= 10;
+    memcpy(bs->buf + bs->len, str, len);
+    bs->len += len;
+}
 
-        if (!val) {
-            break;
-        }
+void kio_buf_sink_init(struct kio_buf_sink *bs, char *buf, size_t size)
+{
+    bs->sink.put = buf_sink_put;
+    bs->buf = buf;
+    bs->size = size;
+    bs->len = 0;
+}
+
+void kio_buf_sink_end(struct kio_buf_sink *bs)
+{
+    if (bs->size) {
+        bs->buf[bs->len] = '\0';
+    }
+}
+
+// "00" to "99", for converting two decimal digits per step
+static const char DEC_DIGIT_PAIRS[200] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+// Writes the decimal digits of 'val' so that they end just before 'end',
+// returning where they start
+static char *u32_to_dec(u32 val, char *end)
+{
+    // One division by a constant (which is a multiply) per two digits
+    while (val >= 100) {
+        u32 quot = val / 100;
+        u32 pair = (val - quot * 100) * 2;
+
+        end -= 2;
+        end[0] = DEC_DIGIT_PAIRS[pair];
+        end[1] = DEC_DIGIT_PAIRS[pair + 1];
+        val = quot;
     }
 
-    if (is_negative) {
-        *(dst++) = '-';
+    if (val >= 10) {
+        end -= 2;
+        end[0] = DEC_DIGIT_PAIRS[val * 2];
+        end[1] = DEC_DIGIT_PAIRS[val * 2 + 1];
+    } else {
+        *--end = (char) ('0' + val);
     }
 
-    count = i;
+    return end;
+}
 
-    while (i) {
-        *(dst++) = (char) ('0' + buf[--i]);
+size_t __utoa10(u64 val, char *dst)
+{
+    char buf[KIO_UTOA_SIZE];
+    char *end = buf + sizeof(buf);
+    char *start;
+    size_t len;
+
+    // Peel off nine digits at a time with a 64 by 32-bit division, so that
+    // the rest is all 32-bit arithmetic
+    while (val >> 32) {
+        u32 chunk;
+
+        val = div_u64_u32(val, 1000000000, &chunk);
+        start = u32_to_dec(chunk, end);
+
+        // Only the leading chunk goes without its leading zeros
+        while (start > end - 9) {
+            *--start = '0';
+        }
+        end = start;
     }
 
-    *dst = '\0';
+    start = u32_to_dec((u32) val, end);
+    len = (size_t) (buf + sizeof(buf) - start);
 
-    return count;
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = start[i];
+    }
+    dst[len] = '\0';
+
+    return len;
 }
 
-size_t __itoa16(int val, char *dst)
+size_t __utoa16(u64 val, char *dst, int upper)
 {
-    static const char HEX_DIGIT_CHARS[16] = "0123456789abcdef";
+    // Added to digit values past 9 to reach 'a' or 'A'
+    const u32 letter_offset = (u32) ((upper ? 'A' : 'a') - '0' - 10);
+    size_t len = 1;
 
-    int buf[8];
-    size_t i = 0;
+    for (u64 rest = val >> 4; rest; rest >>= 4) {
+        ++len;
+    }
+
+    for (size_t i = len; i--; val >>= 4) {
+        u32 digit = (u32) val & 0x0f;
+
+        // 9 - digit wraps around, setting the top bit, only for letters
+        u32 is_letter = -((9 - digit) >> 31);
+
+        dst[i] = (char) ('0' + digit + (is_letter & letter_offset));
+    }
+
+    dst[len] = '\0';
 
-    while (i < ARRLEN(buf)) {
-        buf[i++] = val & 0x0f;
-        val >>= 4;
+    return len;
+}
+
+size_t __utoa8(u64 val, char *dst)
+{
+    size_t len = 1;
+
+    for (u64 rest = val >> 3; rest; rest >>= 3) {
+        ++len;
     }
 
-    while (i) {
-        *(dst++) = HEX_DIGIT_CHARS[buf[--i]];
+    for (size_t i = len; i--; val >>= 3) {
+        dst[i] = (char) ('0' + ((u32) val & 0x07));
     }
 
-    *dst = '\0';
+    dst[len] = '\0';
 
-    return 8;
+    return len;
 }
 
 // Format specifiers (the type of the var arg)
@@ -134,13 +220,17 @@ enum fmtlen {
     FL_LONG_DOUBLE, // L
 };
 
+// Width and precision values other than plain numbers
+#define FMT_FROM_ARG        (-1)    // '*': taken from the next vararg
+#define FMT_UNSPECIFIED     (-2)    // No precision given
+
 // Pack all of this information up neatly
 struct fmtinfo {
     enum fmttype    ft;
     enum fmtflags   ff;
     enum fmtlen     fl;
-    int             width;      // -1 if specified in vararg, 0 if unspecified
-    int             precision;  // -1 if specified in vararg, 0 if unspecified
+    int             width;      // FMT_FROM_ARG for '*', 0 if unspecified
+    int             precision;  // FMT_FROM_ARG for '*', or FMT_UNSPECIFIED
     int             upper;      // Make letter digit chars uppercase (eg 0xFF)
 };
 
@@ -164,6 +254,8 @@ size_t __va_str_format_proc(const char *fmt, struct fmtinfo *fip)
 
     struct fmtinfo fi = { 0 };
 
+    fi.precision = FMT_UNSPECIFIED;
+
     enum {
         could_be_flags      = 1,
         could_be_width      = 2,
@@ -246,7 +338,7 @@ size_t __va_str_format_proc(const char *fmt, struct fmtinfo *fip)
             } else if (fmtc == '*') {
                 // Asterisk denotes that the width is specified by the next
                 // var arg
-                fi.width = -1;
+                fi.width = FMT_FROM_ARG;
             } else {
                 is_width = 0;
             }
@@ -287,19 +379,22 @@ size_t __va_str_format_proc(const char *fmt, struct fmtinfo *fip)
                         }
 
                         fi.precision = precision;
+                        // Backtrack by 1 (accounts for null-term check
+                        // overshot)
+                        --fmti;
+                        --fmt;
                     } else if (fmtc == '*') {
                         // Asterisk denotes that the precision is specified by
                         // the next var arg.
-                        fi.width = -1;
+                        fi.precision = FMT_FROM_ARG;
                     } else {
+                        // A lone '.' means a precision of zero. This char is
+                        // something else, so let the checks below see it.
+                        fi.precision = 0;
                         is_precision = 0;
                     }
                 }
 
-                // Backtrack by 1 (accounts for null-term check overshot)
-                --fmti;
-                --fmt;
-
             } else {
                 is_precision = 0;
             }
@@ -327,10 +422,10 @@ size_t __va_str_format_proc(const char *fmt, struct fmtinfo *fip)
                 }
                 break;
             case 'l':
-                fi.fl = FL_LONG_LONG;
+                fi.fl = FL_LONG;
                 // Check to see if the next char is another l (for 'll')
                 if (++fmti, (fmtc = *(fmt++)) && fmtc == 'l') {
-                    fi.fl = FL_LONG;
+                    fi.fl = FL_LONG_LONG;
                 } else {
                     // If not, backtrack
                     --fmti;
@@ -436,22 +531,54 @@ size_t __va_str_format_proc(const char *fmt, struct fmtinfo *fip)
     return fmti;
 }
 
-// Processes string 'fmt' into buffer 'str' of size 'sz' using data from 'args'
-// Returns the number of characters written into buffer 'str'
-size_t __va_str_format_impl(char *str, size_t sz, const char *fmt,
-    va_list args)
+// Writes a whole field: 'prefix' (sign or radix), 'zeros' leading zeros and
+// 'len' chars of 'body', padded out to the width in one go. Returns the
+// number of chars written.
+static size_t format_field(struct kio_sink *sink, const struct fmtinfo *fi,
+    const char *prefix, size_t zeros, const char *body, size_t len)
 {
-    // Remember the size we were originally given, so we can report the diff.
-    size_t          old_sz = sz;
+    size_t prefix_len = prefix[0] ? (prefix[1] ? 2 : 1) : 0;
+    size_t used = prefix_len + zeros + len;
+    size_t pad = 0;
 
-    // Buffer for formatting things into - for use with atoi, etc.
-    char            fmtbuf[128];
+    if ((size_t) fi->width > used) {
+        pad = (size_t) fi->width - used;
+    }
 
-    // Format info of each formatting key
-    struct fmtinfo  fi;
+    if (fi->ff & FF_LJUSTIFY) {
+        sink_put(sink, prefix, prefix_len);
+        sink_pad(sink, s_pad_zeros, zeros);
+        sink_put(sink, body, len);
+        sink_pad(sink, s_pad_spaces, pad);
+    } else if (fi->ff & FF_ZEROPAD) {
+        sink_put(sink, prefix, prefix_len);
+        sink_pad(sink, s_pad_zeros, zeros + pad);
+        sink_put(sink, body, len);
+    } else {
+        sink_pad(sink, s_pad_spaces, pad);
+        sink_put(sink, prefix, prefix_len);
+        sink_pad(sink, s_pad_zeros, zeros);
+        sink_put(sink, body, len);
+    }
+
+    return used + pad;
+}
+
+// Formats one conversion, taking its argument (if any) from 'args'. Returns
+// the number of chars written.
+static size_t format_conversion(struct kio_sink *sink,
+    const struct fmtinfo *fip, va_list *argsp)
+{
+    struct fmtinfo  fi = *fip;
+
+    // Buffer for formatting things into - for use with atoi, etc.
+    char            fmtbuf[KIO_UTOA_SIZE];
+    size_t          len;
 
     // Storage place for each arg type retrieved from args.
     union {
+        int64_t         i64;
+        uint64_t        u64;
         int32_t         i32;
         uint32_t        u32;
         int16_t         i16;
@@ -461,105 +588,367 @@ size_t __va_str_format_impl(char *str, size_t sz, const char *fmt,
         const char      *str;
     } arg;
 
-    // Char from fmt
-    char fmtc;
+    if (fi.ft == FT_ESCAPE) {
+        return sink_put(sink, "%", 1);
+    }
 
-    while ((fmtc = *(fmt++))) {
-        if (fmtc == '%') {
-            size_t count = __va_str_format_proc(fmt, &fi);
-            fmt += count;
+    if (fi.ft == FT_INVALID) {
+        return sink_put(sink, "<invalid>", 9);
+    }
 
-            if (fi.ft == FT_ESCAPE) {
-                sz -= __sputs(&str, "%", sz);
-                continue;
-            }
+    // Width and precision from varargs come before the value itself. As in
+    // C, a negative width left-justifies and a negative precision is none.
+    if (fi.width == FMT_FROM_ARG) {
+        fi.width = va_arg(*argsp, int);
+        if (fi.width < 0) {
+            fi.ff |= FF_LJUSTIFY;
+            fi.width = -fi.width;
+        }
+    }
 
-            if (fi.ft == FT_INVALID) {
-                sz -= __sputs(&str, "<invalid>", sz);
-                continue;
-            }
+    if (fi.precision == FMT_FROM_ARG) {
+        fi.precision = va_arg(*argsp, int);
+        if (fi.precision < 0) {
+            fi.precision = FMT_UNSPECIFIED;
+        }
+    }
 
-            if (fi.ft == FT_CHAR) {
-                arg.i8 = va_arg(args, char);
-                if (sz--) {
-                    *str = arg.i8;
-                    ++str;
-                }
-                continue;
-            }
+    if (fi.ft == FT_CHAR) {
+        arg.i8 = (int8_t) va_arg(*argsp, int);
+        fi.ff &= ~FF_ZEROPAD;
+        return format_field(sink, &fi, "", 0, (const char *) &arg.i8, 1);
+    }
 
-            if (fi.ft == FT_STR) {
-                arg.str = va_arg(args, const char *);
-                sz -= __sputs(&str, arg.str, sz);
-                continue;
-            }
+    if (fi.ft == FT_STR) {
+        arg.str = va_arg(*argsp, const char *);
+        if (!arg.str) {
+            arg.str = "(null)";
+        }
 
-            if (fi.ft == FT_PTR) {
-                arg.u32 = va_arg(args, uint32_t);
-                __itoa16(arg.u32, fmtbuf);
-                sz -= __sputs(&str, "0x", sz);
-                sz -= __sputs(&str, fmtbuf, sz);
-                continue;
-            }
+        // Precision limits how much of the string is read, not just shown
+        len = 0;
+        while ((fi.precision == FMT_UNSPECIFIED ||
+                len < (size_t) fi.precision) && arg.str[len]) {
+            ++len;
+        }
 
-            if (fi.ft == FT_SIGNED || fi.ft == FT_UNSIGNED) {
-                arg.i32 = va_arg(args, int32_t);
-                __itoa10(arg.i32, fmtbuf);
-            }
+        fi.ff &= ~FF_ZEROPAD;
+        return format_field(sink, &fi, "", 0, arg.str, len);
+    }
 
-            if (fi.ft == FT_HEX) {
-                arg.u32 = va_arg(args, uint32_t);
-                __itoa16(arg.u32, fmtbuf);
+    if (fi.ft == FT_PTR) {
+        // Pointers are always shown in full
+        arg.u64 = (uintptr_t) va_arg(*argsp, void *);
+        len = __utoa16(arg.u64, fmtbuf, fi.upper);
+        fi.ff &= ~FF_ZEROPAD;
+        return format_field(sink, &fi, "0x", sizeof(void *) * 2 - len,
+            fmtbuf, len);
+    }
 
-                if (fi.ff & FF_EXPLICIT) {
-                    sz -= __sputs(&str, "0x", sz);
-                }
-            }
+    if (fi.ft != FT_SIGNED && fi.ft != FT_UNSIGNED &&
+            fi.ft != FT_HEX && fi.ft != FT_OCTAL) {
+        return sink_put(sink, "<unsupported>", 13);
+    }
 
-            size_t start_index = 0;
+    // 'll' and 'j' take 64 bits, and 'l', 'z' and 't' are as wide as a
+    // long. Anything narrower arrives promoted to an int, and 'hh' and 'h'
+    // cut it back down.
+    if (fi.fl == FL_LONG_LONG || fi.fl == FL_INTMAX) {
+        arg.u64 = va_arg(*argsp, uint64_t);
+    } else if (fi.fl == FL_LONG || fi.fl == FL_SIZE ||
+            fi.fl == FL_PTRDIFF) {
+        if (fi.ft == FT_SIGNED) {
+            arg.i64 = va_arg(*argsp, long);
+        } else {
+            arg.u64 = va_arg(*argsp, unsigned long);
+        }
+    } else if (fi.ft == FT_SIGNED) {
+        arg.i64 = va_arg(*argsp, int);
+        if (fi.fl == FL_CHAR) {
+            arg.i64 = (int8_t) arg.i64;
+        } else if (fi.fl == FL_SHORT) {
+            arg.i64 = (int16_t) arg.i64;
+        }
+    } else {
+        arg.u64 = va_arg(*argsp, unsigned int);
+        if (fi.fl == FL_CHAR) {
+            arg.u64 = (uint8_t) arg.u64;
+        } else if (fi.fl == FL_SHORT) {
+            arg.u64 = (uint16_t) arg.u64;
+        }
+    }
 
-            // TODO: fix bug with this - zero padding + width combo
+    const char *prefix = "";
 
-            if (fi.width) {
-                if (fi.width > 8) {
-                    fi.width = 8;
-                }
-                start_index = (8 - (size_t) fi.width);
-            }
+    if (fi.ft == FT_SIGNED) {
+        if (arg.i64 < 0) {
+            prefix = "-";
+            arg.u64 = -arg.u64;
+        } else if (fi.ff & FF_POSSIGN) {
+            prefix = "+";
+        } else if (fi.ff & FF_PADSIGN) {
+            prefix = " ";
+        }
+    } else if (fi.ft == FT_HEX && (fi.ff & FF_EXPLICIT) && arg.u64) {
+        prefix = fi.upper ? "0X" : "0x";
+    }
 
-            if (!(fi.ff & FF_ZEROPAD)) {
-                for (size_t i = 0; i < sizeof(fmtbuf) && fmtbuf[i]; ++i) {
-                    if (fmtbuf[i] != '0') {
-                        start_index = i;
-                        break;
-                    }
-                }
-            }
+    // A precision of zero shows a zero value as no digits at all
+    if (!arg.u64 && !fi.precision) {
+        len = 0;
+    } else if (fi.ft == FT_OCTAL) {
+        len = __utoa8(arg.u64, fmtbuf);
+    } else if (fi.ft == FT_HEX) {
+        len = __utoa16(arg.u64, fmtbuf, fi.upper);
+    } else {
+        len = __utoa10(arg.u64, fmtbuf);
+    }
 
-            if (fi.upper) {
-                for (size_t i = start_index; i < sizeof(fmtbuf); ++i) {
-                    fmtbuf[i] = toupper(fmtbuf[i]);
-                }
-            }
+    // Precision is the minimum number of digits. Given one, the '0' flag is
+    // ignored, as in C.
+    size_t zeros = 0;
 
-            sz -= __sputs(&str, fmtbuf + start_index, sz);
+    if (fi.precision != FMT_UNSPECIFIED) {
+        fi.ff &= ~FF_ZEROPAD;
+        if ((size_t) fi.precision > len) {
+            zeros = (size_t) fi.precision - len;
+        }
+    }
+
+    // '#' makes octal always start with a zero
+    if (fi.ft == FT_OCTAL && (fi.ff & FF_EXPLICIT) && !zeros &&
+            (!len || fmtbuf[0] != '0')) {
+        zeros = 1;
+    }
 
+    return format_field(sink, &fi, prefix, zeros, fmtbuf, len);
+}
+
+// Parsed format strings, keyed by address: each is a list of literal runs,
+// each followed by a conversion, except for the last. Formats that are used
+// again skip the parsing, and literal runs go to the sink in one go.
+//
+// Only formats in .rodata are cached, since only there is the text at an
+// address sure never to change. Formats with more than FMT_CACHE_OPS - 1
+// conversions are cached with no ops, which says to format them directly.
+#define FMT_CACHE_ENTRIES   32  // Must be a power of two
+#define FMT_CACHE_OPS       8
+
+struct fmtop {
+    const char      *literal;
+    u16             literal_len;
+    u16             has_conversion;
+    struct fmtinfo  fi;
+};
+
+struct fmtcache_entry {
+    // Even when the entry is stable, odd while it is being written. The
+    // formatter can run in interrupts, so readers copy an entry out and
+    // check that this didn't change meanwhile.
+    volatile u32    seq;
+    const char      *fmt;
+    u32             op_count;       // 0 if there are too many to cache
+    struct fmtop    ops[FMT_CACHE_OPS];
+};
+
+extern const char __rodata_start[];
+extern const char __rodata_end[];
+
+static struct fmtcache_entry s_fmtcache[FMT_CACHE_ENTRIES];
+static u32 s_fmtcache_hits;
+static u32 s_fmtcache_misses;
+
+static INLINE struct fmtcache_entry *fmtcache_slot(const char *fmt)
+{
+    // Format strings are byte aligned; mix in the higher bits
+    u32 addr = (u32) (uintptr_t) fmt;
+    return &s_fmtcache[(addr ^ (addr >> 5)) & (FMT_CACHE_ENTRIES - 1)];
+}
+
+static INLINE bool fmtcache_wanted(const char *fmt)
+{
+    return fmt >= __rodata_start && fmt < __rodata_end;
+}
+
+// Copies the cached parse of 'fmt' into 'ops' and its op count into 'count'.
+// Returns false if it isn't cached.
+static bool fmtcache_lookup(const char *fmt, struct fmtop *ops, u32 *countp)
+{
+    const struct fmtcache_entry *entry = fmtcache_slot(fmt);
+    u32 seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    u32 count;
+
+    if ((seq & 1) || entry->fmt != fmt) {
+        return false;
+    }
+
+    count = entry->op_count;
+    for (u32 i = 0; i < count && i < FMT_CACHE_OPS; ++i) {
+        ops[i] = entry->ops[i];
+    }
+
+    // Replaced under us
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (entry->seq != seq) {
+        return false;
+    }
+
+    *countp = count;
+    return true;
+}
+
+static void fmtcache_insert(const char *fmt, const struct fmtop *ops,
+    u32 count)
+{
+    struct fmtcache_entry *entry = fmtcache_slot(fmt);
+    u32 seq = entry->seq;
+
+    // Give up if someone else is writing it, e.g. the code we interrupted
+    if ((seq & 1) || !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    entry->fmt = fmt;
+    entry->op_count = count;
+    for (u32 i = 0; i < count; ++i) {
+        entry->ops[i] = ops[i];
+    }
+
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Parses 'fmt' into ops. Returns the op count, or 0 if there are too many.
+static u32 parse_format(const char *fmt, struct fmtop *ops)
+{
+    u32 count = 0;
+
+    for (;;) {
+        struct fmtop *op = &ops[count++];
+        const char *end = fmt;
+
+        while (*end && *end != '%') {
+            ++end;
+        }
+
+        op->literal = fmt;
+        op->literal_len = (u16) (end - fmt);
+        op->has_conversion = (*end == '%');
+
+        if (!op->has_conversion) {
+            return count;
+        }
+
+        if (count == FMT_CACHE_OPS) {
+            return 0;
+        }
+
+        fmt = end + 1;
+        fmt += __va_str_format_proc(fmt, &op->fi);
+
+        // The parser consumes the terminator of a truncated specifier
+        if (!fmt[-1]) {
+            --fmt;
+        }
+    }
+}
+
+// Formats 'fmt' with data from 'args', handing the output to 'sink' as it
+// goes. Returns the number of chars produced.
+static size_t format(struct kio_sink *sink, const char *fmt, va_list args)
+{
+    size_t          count = 0;
+
+    struct fmtop    ops[FMT_CACHE_OPS];
+    u32             op_count = 0;
+
+    // Conversions take their arguments through a pointer to this
+    va_list         ap;
+
+    va_copy(ap, args);
+
+    if (fmtcache_wanted(fmt)) {
+        if (fmtcache_lookup(fmt, ops, &op_count)) {
+            ++s_fmtcache_hits;
         } else {
-            *(str++) = fmtc;
-            --sz;
+            ++s_fmtcache_misses;
+            op_count = parse_format(fmt, ops);
+            fmtcache_insert(fmt, ops, op_count);
+        }
+    }
+
+    if (op_count) {
+        for (u32 i = 0; i < op_count; ++i) {
+            count += sink_put(sink, ops[i].literal, ops[i].literal_len);
+            if (ops[i].has_conversion) {
+                count += format_conversion(sink, &ops[i].fi, &ap);
+            }
+        }
+        va_end(ap);
+        return count;
+    }
+
+    // Not in .rodata, or too many conversions: parse as we go
+    for (;;) {
+        const char *end = fmt;
+        struct fmtinfo fi;
+
+        while (*end && *end != '%') {
+            ++end;
+        }
+        count += sink_put(sink, fmt, (size_t) (end - fmt));
+
+        if (!*end) {
+            break;
+        }
+
+        fmt = end + 1;
+        fmt += __va_str_format_proc(fmt, &fi);
+        count += format_conversion(sink, &fi, &ap);
+
+        // The parser consumes the terminator of a truncated specifier
+        if (!fmt[-1]) {
+            break;
         }
     }
 
-    // Add a null-ternimator to the end.
-    *(str++) = 0;
-    --sz;
+    va_end(ap);
+    return count;
+}
 
-    return old_sz - sz;
+void kio_get_fmtcache_stats(u32 *hits, u32 *misses)
+{
+    *hits = s_fmtcache_hits;
+    *misses = s_fmtcache_misses;
+}
+
+int kvfprintf(struct kio_sink *sink, const char *fmt, va_list args)
+{
+    return (int) format(sink, fmt, args);
+}
+
+int kfprintf(struct kio_sink *sink, const char *fmt, ...)
+{
+    int result;
+    va_list args;
+
+    va_start(args, fmt);
+    result = kvfprintf(sink, fmt, args);
+    va_end(args);
+
+    return result;
 }
 
 int kvsnprintf(char *str, size_t sz, const char *fmt, va_list args)
 {
-    return (int) __va_str_format_impl(str, sz, fmt, args);
+    struct kio_buf_sink bs;
+    int result;
+
+    kio_buf_sink_init(&bs, str, sz);
+    result = (int) format(&bs.sink, fmt, args);
+    kio_buf_sink_end(&bs);
+
+    return result;
 }
 
 int ksnprintf(char *str, size_t sz, const char *fmt, ...)
@@ -576,7 +965,7 @@ int ksnprintf(char *str, size_t sz, const char *fmt, ...)
 
 int kvsprintf(char *str, const char *fmt, va_list args)
 {
-    return (int) __va_str_format_impl(str, 0, fmt, args);
+    return kvsnprintf(str, (size_t) -1, fmt, args);
 }
 
 int ksprintf(char *str, const char *fmt, ...)
@@ -591,18 +980,21 @@ int ksprintf(char *str, const char *fmt, ...)
     return result;
 }
 
-int kvprintf(const char *fmt, va_list args)
+static void out_sink_put(struct kio_sink *sink, const char *str, size_t len)
 {
-    if (!s_outbuf_zeroed) {
-        kmemset((void *) s_outbuf, OUTBUF_SIZE, 0);
-        s_outbuf_zeroed = 1;
-    }
+    (void) sink;
+    con_sink.put(&con_sink, str, len);
+    serial_sink.put(&serial_sink, str, len);
+}
 
-    int result = (int) __va_str_format_impl(s_outbuf, OUTBUF_SIZE, fmt, args);
+struct kio_sink kio_out_sink = { out_sink_put };
 
-    con_write_str(s_outbuf);
+int kvprintf(const char *fmt, va_list args)
+{
+    // Keep the console in order: anything logged earlier goes out first
+    klog_flush();
 
-    return result;
+    return kvfprintf(&kio_out_sink, fmt, args);
 }
 
 int kprintf(const char *fmt, ...)
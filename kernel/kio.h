@@ -4,6 +4,35 @@
 #include <stdarg.h>
 #include <stddef.h>
 
+#include <kernel/types.h>
+
+// Big enough for any __utoa*() result, terminator included: a 64-bit value
+// is up to 20 decimal or 22 octal digits
+#define KIO_UTOA_SIZE   24
+
+// Destination for formatted output. The formatter hands each literal run
+// and formatted field to put() as soon as it has it, so nothing is staged in
+// between; a line can be on screen before the rest of it is formatted.
+struct kio_sink {
+    void (*put)(struct kio_sink *sink, const char *str, size_t len);
+};
+
+// Sink into a caller's buffer, as used by ksnprintf(). Output beyond 'size'
+// minus one is dropped; the terminator is only added by kio_buf_sink_end().
+struct kio_buf_sink {
+    struct kio_sink sink;
+    char            *buf;
+    size_t          size;
+    size_t          len;        // Chars stored so far
+};
+
+void kio_buf_sink_init(struct kio_buf_sink *bs, char *buf, size_t size);
+void kio_buf_sink_end(struct kio_buf_sink *bs);
+
+// Each returns the number of chars produced, without a terminator. For the
+// ksnprintf() family that is the length had the buffer been big enough.
+int kvfprintf(struct kio_sink *sink, const char *fmt, va_list args);
+int kfprintf(struct kio_sink *sink, const char *fmt, ...);
 int kvsnprintf(char *str, size_t sz, const char *fmt, va_list args);
 int ksnprintf(char *str, size_t sz, const char *fmt, ...);
 int kvsprintf(char *str, const char *fmt, va_list args);
@@ -11,4 +40,20 @@ int ksprintf(char *str, const char *fmt, ...);
 int kvprintf(const char *fmt, va_list args);
 int kprintf(const char *fmt, ...);
 
+// The kernel's standard output: the console, mirrored to the serial line so
+// that a headless machine shows it too. kprintf() and the write system calls
+// go here.
+extern struct kio_sink kio_out_sink;
+
+// Integer to string conversion, as used by the formatter. Each writes the
+// digits of 'val', without leading zeros, and a terminator to 'dst', and
+// returns the number of digits.
+size_t __utoa10(u64 val, char *dst);
+size_t __utoa16(u64 val, char *dst, int upper);
+size_t __utoa8(u64 val, char *dst);
+
+// Format strings in .rodata are parsed once and then served from a small
+// cache. Reports how many formats were found there and how many weren't.
+void kio_get_fmtcache_stats(u32 *hits, u32 *misses);
+
 #endif /* _INC_KIO */
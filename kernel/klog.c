@@ -1,17 +1,249 @@
 #include <stdarg.h>
+#include <string.h>
 
+#include <kernel/kernel.h>
 #include <kernel/klog.h>
+#include <kernel/asm/misc.h>
 
 #include "kio.h"
+#include "con.h"
+#include "vdata.h"
 
-int klog_printf(const char *format, ...)
+#define KLOG_MASK           (KLOG_RECORDS - 1)
+
+// Room for "[sssss.uuuuuu] " and a record's text
+#define KLOG_LINE_SIZE      (16 + KLOG_TEXT_SIZE)
+
+struct klog_record {
+    // Sequence number + 1 once the record is complete; 0 while a producer is
+    // still writing it
+    volatile u32    commit;
+    u32             reserved;
+    u64             timestamp;      // Nanoseconds since boot
+    char            text[KLOG_TEXT_SIZE];
+};
+
+static struct klog_record s_records[KLOG_RECORDS];
+
+// Next sequence number to hand out. Producers claim records by incrementing
+// it atomically, which is all the synchronisation they need.
+static volatile u32 s_head;
+
+// Next sequence number to flush; only touched by the flushing context
+static u32 s_tail;
+static volatile u32 s_flushing;
+static u32 s_dropped;
+
+// Whether the last record flushed ended a line, so the next gets a prefix
+static bool s_line_start = true;
+
+static struct kio_sink *s_sinks[KLOG_MAX_SINKS] = { &con_sink };
+
+// Tags logged at levels other than error
+static volatile u32 s_tag_mask = KLOG_ALL_TAGS;
+
+// Message prefixes, indexed by tag
+static const char *const s_tag_prefixes[KLOG_TAG_COUNT] = {
+    [KLOG_KERNEL]   = "",
+    [KLOG_CON]      = "con: ",
+    [KLOG_ELF]      = "elf: ",
+    [KLOG_FPU]      = "fpu: ",
+    [KLOG_FRAME]    = "frame: ",
+    [KLOG_GDT]      = "gdt: ",
+    [KLOG_IDT]      = "idt: ",
+    [KLOG_IPC]      = "ipc: ",
+    [KLOG_IRQ]      = "irq: ",
+    [KLOG_ISR]      = "isr: ",
+    [KLOG_KB]       = "kb: ",
+    [KLOG_MOUSE]    = "mouse: ",
+    [KLOG_PAGE]     = "page: ",
+    [KLOG_PIC]      = "pic: ",
+    [KLOG_PROC]     = "proc: ",
+    [KLOG_PS2]      = "ps2: ",
+    [KLOG_SERIAL]   = "serial: ",
+    [KLOG_SYSCALL]  = "syscall: ",
+    [KLOG_URING]    = "uring: ",
+    [KLOG_USERMODE] = "usermode: ",
+    [KLOG_VDATA]    = "vdata: ",
+    [KLOG_VGA]      = "vga: ",
+    [KLOG_VM]       = "vm: ",
+};
+
+// Formats a message, after 'prefix', into a newly claimed record
+static int log_record(const char *prefix, const char *format, va_list args)
+{
+    u32 seq = __atomic_fetch_add(&s_head, 1, __ATOMIC_RELAXED);
+    struct klog_record *record = &s_records[seq & KLOG_MASK];
+    struct kio_buf_sink bs;
+    int len;
+
+    // Un-commit first, so a flush in progress can tell the record changed
+    record->commit = 0;
+    barrier();
+
+    record->timestamp = vdata_get_monotonic_ns();
+
+    // Formatted straight into the record
+    kio_buf_sink_init(&bs, record->text, sizeof(record->text));
+    len = (int) strlen(prefix);
+    bs.sink.put(&bs.sink, prefix, (size_t) len);
+    len += kvfprintf(&bs.sink, format, args);
+    kio_buf_sink_end(&bs);
+
+    // Cut short: keep the line break, so the next record starts a new line
+    if (len >= (int) sizeof(record->text) &&
+            record->text[sizeof(record->text) - 2] != '\n') {
+        record->text[sizeof(record->text) - 2] = '\n';
+    }
+
+    __atomic_store_n(&record->commit, seq + 1, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+int klog_log(int level, enum klog_tag tag, const char *format, ...)
 {
     int return_val;
     va_list args;
 
+    if (level != KLOG_LEVEL_ERR && !(s_tag_mask & KLOG_TAG_BIT(tag))) {
+        return 0;
+    }
+
     va_start(args, format);
-    return_val = kvprintf(format, args);
+    return_val = log_record(s_tag_prefixes[tag], format, args);
     va_end(args);
 
     return return_val;
 }
+
+void klog_set_mask(u32 tags)
+{
+    s_tag_mask = tags & KLOG_ALL_TAGS;
+}
+
+u32 klog_get_mask(void)
+{
+    return s_tag_mask;
+}
+
+// Writes 'value' as 'digits' decimal digits, zero padded, returning the end
+static char *put_digits(char *dst, u32 value, int digits)
+{
+    for (int i = digits - 1; i >= 0; --i) {
+        dst[i] = (char) ('0' + value % 10);
+        value /= 10;
+    }
+    return dst + digits;
+}
+
+// Formats "[sssss.uuuuuu] " into dst, returning the end
+static char *put_timestamp(char *dst, u64 ns)
+{
+    u32 rem;
+    u32 sec = (u32) div_u64_u32(ns, 1000000000, &rem);
+
+    *dst++ = '[';
+    dst = put_digits(dst, sec % 100000, 5);
+    *dst++ = '.';
+    dst = put_digits(dst, rem / 1000, 6);
+    *dst++ = ']';
+    *dst++ = ' ';
+
+    return dst;
+}
+
+static void emit(const char *str, size_t len)
+{
+    for (int i = 0; i < KLOG_MAX_SINKS && s_sinks[i]; ++i) {
+        s_sinks[i]->put(s_sinks[i], str, len);
+    }
+}
+
+static void emit_dropped(u32 count)
+{
+    for (int i = 0; i < KLOG_MAX_SINKS && s_sinks[i]; ++i) {
+        kfprintf(s_sinks[i], "klog: %d messages dropped\n", count);
+    }
+}
+
+void klog_flush(void)
+{
+    char line[KLOG_LINE_SIZE];
+    u32 dropped = 0;
+
+    if (__atomic_exchange_n(&s_flushing, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    for (;;) {
+        u32 head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+        const struct klog_record *record;
+        size_t len = 0;
+
+        if (s_tail == head) {
+            break;
+        }
+
+        // Lapped: everything older than a full ring is gone
+        if (head - s_tail > KLOG_RECORDS) {
+            dropped += head - KLOG_RECORDS - s_tail;
+            s_tail = head - KLOG_RECORDS;
+        }
+
+        record = &s_records[s_tail & KLOG_MASK];
+
+        // Still being written; pick it up next time
+        if (__atomic_load_n(&record->commit, __ATOMIC_ACQUIRE) != s_tail + 1) {
+            break;
+        }
+
+        if (s_line_start) {
+            len = (size_t) (put_timestamp(line, record->timestamp) - line);
+        }
+        for (size_t i = 0; i < sizeof(record->text) && record->text[i]; ++i) {
+            line[len++] = record->text[i];
+        }
+        barrier();
+
+        // Overwritten while we copied it
+        if (record->commit != s_tail + 1) {
+            ++dropped;
+            ++s_tail;
+            continue;
+        }
+
+        if (dropped) {
+            emit_dropped(dropped);
+            s_dropped += dropped;
+            dropped = 0;
+        }
+
+        emit(line, len);
+        s_line_start = (len && line[len - 1] == '\n');
+        ++s_tail;
+    }
+
+    if (dropped) {
+        emit_dropped(dropped);
+        s_dropped += dropped;
+    }
+
+    __atomic_store_n(&s_flushing, 0, __ATOMIC_RELEASE);
+}
+
+int klog_add_sink(struct kio_sink *sink)
+{
+    for (int i = 0; i < KLOG_MAX_SINKS; ++i) {
+        if (!s_sinks[i]) {
+            s_sinks[i] = sink;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+u32 klog_get_dropped(void)
+{
+    return s_dropped;
+}
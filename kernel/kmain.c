@@ -2,19 +2,39 @@
 
 #include <kernel/kernel.h>
 #include <kernel/klog.h>
+#include <kernel/irqtrace.h>
+#include <kernel/ktrace.h>
 #include <kernel/asm/misc.h>
 
 #include "boot.h"
 #include "con.h"
+#include "kio.h"
 #include "panic.h"
+#include "cpu/gdt.h"
 #include "cpu/idt.h"
 #include "cpu/isr.h"
+#include "cpu/fpu.h"
+#include "cpu/syscall.h"
+#include "cpu/usermode.h"
 #include "ps2.h"
 #include "irq.h"
 #include "kb.h"
 #include "vga.h"
 #include "mem/page.h"
+#include "mem/frame.h"
+#include "mem/vm.h"
 #include "pit.h"
+#include "bench.h"
+#include "vdata.h"
+#include "uring.h"
+#include "proc.h"
+#include "ipc.h"
+#include "serial.h"
+#include "user_images.h"
+
+// Set from the keyboard ISR, serviced from the idle loop
+static volatile bool s_run_benchmarks = false;
+static volatile bool s_run_forktest = false;
 
 static int on_key_event(const struct kb_key *key)
 {
@@ -22,6 +42,13 @@ static int on_key_event(const struct kb_key *key)
 
     // Only process key-presses
     if (key->event == KB_PRESS) {
+        // Alt+F1..F4 switch virtual consoles
+        if ((key->modifiers & KB_MOD_ALT) &&
+                keycode >= KB_KEY_F1 && keycode < KB_KEY_F1 + CON_COUNT) {
+            con_switch(keycode - KB_KEY_F1);
+            return 0;
+        }
+
         // If the control key is being held, perform an action
         if (key->modifiers & KB_MOD_CTRL) {
             if (keycode == 'l') {
@@ -32,6 +59,24 @@ static int on_key_event(const struct kb_key *key)
                 panic("manual panic (ctrl+p)\n");
             } else if (keycode == 'a') {
                 con_write_char('\r');
+            } else if (keycode == 'i') {
+                // Dump interrupt statistics
+                irq_dump_stats();
+            } else if (keycode == 't') {
+                // Dump interrupt latency traces
+                irqtrace_dump();
+            } else if (keycode == 'k') {
+                // Dump the binary trace log
+                ktrace_dump();
+            } else if (keycode == 's') {
+                // Dump system call statistics
+                syscall_dump_stats();
+            } else if (keycode == 'b') {
+                // Run the benchmarks once we're back in the idle loop
+                s_run_benchmarks = true;
+            } else if (keycode == 'e') {
+                // Run the fork/exec demo program from the idle loop
+                s_run_forktest = true;
             } else {
                 // No appropriate command, print the letter preceded by a '^'
                 con_write_char('^');
@@ -48,13 +93,40 @@ static int on_key_event(const struct kb_key *key)
                 keycode = toupper(keycode);
             }
 
-            con_write_char(keycode);
+            // Typing goes to whichever console is on screen
+            console_write_char(con_get_active(), keycode);
         }
     }
 
     return 0;
 }
 
+// Runs a built-in program to completion
+static void run_image(const char *name)
+{
+    const struct user_image *image = user_image_find(name);
+    int pid;
+    int exit_code;
+    int result;
+
+    if (!image) {
+        kprintf("no such program: %s\n", name);
+        return;
+    }
+
+    result = proc_exec(image->name, image->start, user_image_size(image), &pid);
+    if (!result) {
+        result = proc_wait(pid, &exit_code);
+    }
+
+    if (result) {
+        kprintf("%s failed: error %d\n", name, result);
+    } else {
+        klog_info(KLOG_KERNEL, "%s (pid %d) exited with %d\n", name, pid,
+            exit_code);
+    }
+}
+
 void CDECL NO_RETURN kmain(void)
 {
     // Get the kernel boot parameter block left by the bootloader.
@@ -65,11 +137,18 @@ void CDECL NO_RETURN kmain(void)
         panic("init error: console problem\n");
     }
 
-    // Initialise the CPU: the IDT and CPU exception ISRs.
-    if (idt_init() || isr_init()) {
+    // Initialise the CPU: our own GDT and TSS, the IDT and CPU exception ISRs.
+    if (gdt_init() || idt_init() || isr_init()) {
         panic("init error: cpu problem\n");
     }
 
+    // FPU and SSE. Not fatal - we just don't get to use them.
+    fpu_init();
+
+    // System call gate, and ring 3 support on top of it.
+    syscall_init();
+    usermode_init();
+
     // Initialise hardware things.
     // We initialise the PS2 controller first, so that we can tell it not to
     // spam us with IRQs before we've gotten our IRQ management sorted out.
@@ -82,6 +161,9 @@ void CDECL NO_RETURN kmain(void)
 
     // From now on, we don't need to panic if a component fails to load.
 
+    // Serial console on COM1, for headless runs.
+    serial_init();
+
     // Keyboard driver.
     kb_init();
     kb_add_listener(on_key_event);
@@ -93,12 +175,45 @@ void CDECL NO_RETURN kmain(void)
     con_set_cursor_shape(CON_CURSOR_SHAPE_UNDERLINE);
 
     page_init();
-    
+
+    // Physical frames and address spaces for user processes.
+    frame_init();
+    vm_init();
+
+    // Kernel data page, which the PIT keeps up to date.
+    vdata_init();
     pit_init();
 
-    klog_printf("init ok\n");
+    // The console can now leave screen updates to the PIT.
+    con_start_deferred_flush();
+
+    // Processes. The code running now becomes process 0.
+    proc_init();
+    ipc_init();
+
+    // Asynchronous system call rings, polled from the PIT.
+    uring_init();
+
+    klog_info(KLOG_KERNEL, "init ok\n");
 
-    
+    run_image("hello");
 
-    while (1) cpu_hlt();
+    while (1) {
+        // Log output is written from here, rather than by whoever logged it
+        klog_flush();
+        cpu_hlt();
+
+        // Let any user processes run before going back to sleep
+        proc_yield();
+
+        if (s_run_forktest) {
+            s_run_forktest = false;
+            run_image("forktest");
+        }
+
+        if (s_run_benchmarks) {
+            s_run_benchmarks = false;
+            bench_run_all();
+        }
+    }
 }
@@ -0,0 +1,98 @@
+#include <stdarg.h>
+
+#include <kernel/kernel.h>
+#include <kernel/ktrace.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpustat.h>
+
+#include "kio.h"
+
+#if KTRACE
+
+#define KTRACE_MASK         (KTRACE_ENTRIES - 1)
+
+struct ktrace_entry {
+    u64         tsc;
+    const char  *format;
+    u16         cpu;
+    u16         nargs;
+    u32         args[KTRACE_MAX_ARGS];
+};
+
+struct ktrace_ring {
+    volatile u32        head;       // Sequence number of the next entry
+    struct ktrace_entry entries[KTRACE_ENTRIES];
+};
+
+static struct ktrace_ring s_rings[KTRACE_MAX_CPUS];
+
+static INLINE u32 current_cpu(void)
+{
+    return 0;
+}
+
+void ktrace_log(const char *format, u32 nargs, ...)
+{
+    u32 cpu = current_cpu();
+    struct ktrace_ring *ring = &s_rings[cpu];
+    u32 seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct ktrace_entry *entry = &ring->entries[seq & KTRACE_MASK];
+    va_list args;
+
+    entry->tsc = rdtsc();
+    entry->format = format;
+    entry->cpu = (u16) cpu;
+    entry->nargs = (u16) nargs;
+
+    // Unused arguments are cleared, so the dump never shows a stale entry's
+    va_start(args, nargs);
+    for (u32 i = 0; i < KTRACE_MAX_ARGS; ++i) {
+        entry->args[i] = (i < nargs) ? va_arg(args, u32) : 0;
+    }
+    va_end(args);
+}
+
+static void dump_ring(const struct ktrace_ring *ring)
+{
+    u32 head = ring->head;
+    u32 first = (head > KTRACE_ENTRIES) ? head - KTRACE_ENTRIES : 0;
+    u64 prev_tsc = 0;
+
+    for (u32 seq = first; seq != head; ++seq) {
+        const struct ktrace_entry *entry = &ring->entries[seq & KTRACE_MASK];
+        u64 delta = prev_tsc ? entry->tsc - prev_tsc : 0;
+
+        prev_tsc = entry->tsc;
+
+        kprintf("%d cpu%d +%d: ", seq, entry->cpu,
+            (delta > 0x7fffffff) ? 0x7fffffff : (u32) delta);
+
+        // Missing arguments are passed as zeroes; printing needs no more
+        // than what the format string asks for
+        kprintf(entry->format, entry->args[0], entry->args[1],
+            entry->args[2], entry->args[3]);
+    }
+}
+
+#endif /* KTRACE */
+
+void ktrace_dump(void)
+{
+#if KTRACE
+    u32 eflags = get_eflags();
+
+    // Nothing gets recorded while we read
+    cli();
+
+    kprintf("ktrace: seq cpu +cycles since previous\n");
+    for (u32 cpu = 0; cpu < KTRACE_MAX_CPUS; ++cpu) {
+        dump_ring(&s_rings[cpu]);
+    }
+
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+#else
+    kprintf("ktrace: disabled; build with KTRACE=1\n");
+#endif
+}
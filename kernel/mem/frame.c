@@ -0,0 +1,109 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpustat.h>
+
+#include "frame.h"
+#include "../panic.h"
+
+// Stack of free frames. Allocation and freeing are both O(1).
+static u32 s_free[FRAME_POOL_COUNT];
+static u32 s_free_count;
+
+// Reference counts, indexed by frame number within the pool
+static u16 s_refs[FRAME_POOL_COUNT];
+
+static u32 to_index(u32 frame, const char *caller)
+{
+    if (frame < FRAME_POOL_START || frame >= FRAME_POOL_END ||
+            (frame & (PAGE_SIZE - 1))) {
+        panic("%s: %p is not a pool frame\n", caller, (void *) frame);
+    }
+
+    return (frame - FRAME_POOL_START) / PAGE_SIZE;
+}
+
+int frame_init(void)
+{
+    // Push in reverse, so allocations start at the bottom of the pool
+    s_free_count = 0;
+    KZEROMEM(s_refs, sizeof(s_refs));
+    for (u32 i = FRAME_POOL_COUNT; i > 0; --i) {
+        s_free[s_free_count++] = FRAME_POOL_START + (i - 1) * PAGE_SIZE;
+    }
+
+    klog_info(KLOG_FRAME, "%u frames at %p-%p\n", s_free_count,
+        (void *) FRAME_POOL_START, (void *) FRAME_POOL_END);
+
+    return 0;
+}
+
+u32 frame_alloc(void)
+{
+    u32 eflags = get_eflags();
+    u32 frame = 0;
+
+    cli();
+    if (s_free_count) {
+        frame = s_free[--s_free_count];
+        s_refs[to_index(frame, "frame_alloc")] = 1;
+    }
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+
+    return frame;
+}
+
+u32 frame_alloc_zeroed(void)
+{
+    u32 frame = frame_alloc();
+
+    if (frame) {
+        KZEROMEM((void *) frame, PAGE_SIZE);
+    }
+
+    return frame;
+}
+
+void frame_ref(u32 frame)
+{
+    u32 index = to_index(frame, "frame_ref");
+    u32 eflags = get_eflags();
+
+    cli();
+    if (!s_refs[index] || s_refs[index] == 0xffff) {
+        panic("frame_ref: bad reference count on %p\n", (void *) frame);
+    }
+    ++s_refs[index];
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+}
+
+void frame_free(u32 frame)
+{
+    u32 index = to_index(frame, "frame_free");
+    u32 eflags = get_eflags();
+
+    cli();
+    if (!s_refs[index]) {
+        panic("frame_free: %p is already free\n", (void *) frame);
+    }
+    if (!--s_refs[index]) {
+        s_free[s_free_count++] = frame;
+    }
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+}
+
+u32 frame_get_refs(u32 frame)
+{
+    return s_refs[to_index(frame, "frame_get_refs")];
+}
+
+u32 frame_get_free_count(void)
+{
+    return s_free_count;
+}
@@ -0,0 +1,41 @@
+#ifndef _INC_FRAME
+#define _INC_FRAME 1
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+
+// Physical page frame allocator. Hands out 4KiB frames from a fixed pool
+// above the kernel heap. All RAM is identity mapped in every address space,
+// so a frame's physical address is also a usable kernel pointer.
+//
+// Frames are reference counted, so that address spaces can share them (see
+// copy-on-write in mem/vm.h). A frame goes back to the pool when its last
+// reference is dropped.
+
+// Must agree with HEAP_END in mem/heap.c
+#define FRAME_POOL_START    0x00800000
+#define FRAME_POOL_END      0x00f00000  // Exclusive; see mem/heap.c
+#define FRAME_POOL_COUNT    ((FRAME_POOL_END - FRAME_POOL_START) / PAGE_SIZE)
+
+int frame_init(void);
+
+// Returns the physical address of a free frame, with one reference, or 0 if
+// there are none. The frame's contents are undefined.
+u32 frame_alloc(void);
+
+// As frame_alloc(), but zero-fills the frame.
+u32 frame_alloc_zeroed(void);
+
+// Adds a reference to an allocated frame.
+void frame_ref(u32 frame);
+
+// Drops a reference to a frame, freeing it if that was the last one.
+void frame_free(u32 frame);
+
+// Number of references to an allocated frame
+u32 frame_get_refs(u32 frame);
+
+// Number of frames currently free
+u32 frame_get_free_count(void);
+
+#endif /* _INC_FRAME */
@@ -12,9 +12,10 @@
    so the heap will begin above this to ensure that we're out of the way. */
 #define HEAP_START ((void *) 0x00200000)
 
-/* 0x00F00000 - 0x00FFFFFF can contain memory mapped hardware, so we'll avoid
-   meddling with this. */
-#define HEAP_END   ((void *) 0x00EFFFFF)
+/* 0x00800000 - 0x00EFFFFF is the page frame pool (see mem/frame.h), and
+   0x00F00000 - 0x00FFFFFF can contain memory mapped hardware, so we'll avoid
+   meddling with either. */
+#define HEAP_END   ((void *) 0x007FFFFF)
 
 // This keeps track of the next free piece of memory.
 static void *_Atomic volatile heap_head = HEAP_START;
@@ -32,7 +32,7 @@ page_indirection* page_alloc(page_allocator *const allocator)
     }
     else
     {
-        klog_printf("page_alloc: Out of memory!\n");
+        klog_err(KLOG_PAGE, "alloc: out of memory\n");
     }
     return 0;
 }
@@ -60,7 +60,7 @@ page_indirection* page_free(page_allocator *const allocator,
     }
     else
     {
-        klog_printf("page_free: Out of memory!\n");
+        klog_err(KLOG_PAGE, "free: out of memory\n");
     }
     return page_ind;
 }
@@ -122,7 +122,7 @@ page_indirection* kpalloc(void)
     {
         next_page_ref->page = next_page;
         next_page += PAGE_SIZE;
-        //klog_printf("Allocated page at %8x, indirecting to %8x\n",
+        //klog_debug(KLOG_PAGE, "Allocated page at %8x, indirecting to %8x\n",
         //    next_page_ref, next_page_ref->page);
     }
 
@@ -252,12 +252,12 @@ int page_init(void)
     kp_allocator_allocator.underlying_buffer.length = 
         0x1000 / sizeof(page_allocator);
 
-    klog_printf("page: allocator initialised\n");
+    klog_info(KLOG_PAGE, "allocator initialised\n");
 
     //irq_enter_high_half();
     //setup_paging();
 
-    klog_printf("page: virtual paging established\n");
+    klog_info(KLOG_PAGE, "virtual paging established\n");
 
     //Example
     //for(int i = 0; i < 0x402; i++) kpalloc();
@@ -9,6 +9,16 @@
 #define Z0TH_PAGE_ADDR 0x10000
 #endif
 
+// Virtual address range available to user-mode code. Everything outside of
+// it belongs to the kernel.
+#ifndef USER_SPACE_START
+#define USER_SPACE_START 0x40000000
+#endif
+
+#ifndef USER_SPACE_END
+#define USER_SPACE_END 0xc0000000
+#endif
+
 #ifndef FRAME_TO_PTR
 #define FRAME_TO_PTR(frno) (frno << 12)
 #endif
@@ -198,7 +208,7 @@ int page_allocator_can_free(page_allocator const allocator);
         }\
         else\
         {\
-            klog_printf("page_alloc: Out of memory!");\
+            klog_err(KLOG_PAGE, "alloc: out of memory\n");\
         }\
         return 0;\
     }\
@@ -227,7 +237,7 @@ int page_allocator_can_free(page_allocator const allocator);
         }\
         else\
         {\
-            klog_printf("page_free: Out of memory!");\
+            klog_err(KLOG_PAGE, "free: out of memory\n");\
         }\
         return ptr;\
     }\
@@ -0,0 +1,517 @@
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/kerror.h>
+#include <kernel/vdata.h>
+#include <kernel/asm/misc.h>
+
+#include "vm.h"
+#include "frame.h"
+#include "page.h"
+#include "../vdata.h"
+
+#define VM_ENTRIES              1024
+#define VM_KERNEL_TABLES        (VM_RAM_SIZE / (VM_ENTRIES * PAGE_SIZE))
+#define VM_USER_PDE_FIRST       VM_PDE_INDEX(USER_SPACE_START)
+#define VM_USER_PDE_END         VM_PDE_INDEX(VM_USER_TOP)   // Exclusive
+
+// Bounds of the kernel image sections that ring 3 may use, from kernel.ld.
+// Code run through usermode_call() and its data live there. The text also
+// holds the SYSENTER stub, so every space can run it; the data is only
+// mapped into the kernel's own space, where usermode_call() runs.
+extern char __user_text_start[];
+extern char __user_text_end[];
+extern char __user_data_start[];
+extern char __user_data_end[];
+
+static u32 s_kernel_directory[VM_ENTRIES] ALIGN(PAGE_SIZE);
+static u32 s_kernel_tables[VM_KERNEL_TABLES][VM_ENTRIES] ALIGN(PAGE_SIZE);
+static u32 s_vdata_table[VM_ENTRIES] ALIGN(PAGE_SIZE);
+
+// Copy of the identity table holding .user_data, with that opened to ring 3.
+// Only s_kernel_directory points at it.
+static u32 s_user_data_table[VM_ENTRIES] ALIGN(PAGE_SIZE);
+static u32 s_user_data_pde;
+
+static struct vm_space s_kernel_space;
+static struct vm_space *s_current;
+
+// Opens up the identity mapping of [start, end) to ring 3, in the table
+// that maps it. kernel.ld keeps each range within one table.
+static void set_user_range(u32 *table, const char *start, const char *end,
+    u32 flags)
+{
+    u32 addr = (u32) start & ~(PAGE_SIZE - 1);
+
+    for (; addr < (u32) end; addr += PAGE_SIZE) {
+        table[VM_PTE_INDEX(addr)] = addr | VM_PRESENT | VM_USER | flags;
+    }
+}
+
+int vm_init(void)
+{
+    u32 vdata_pde = VM_PDE_INDEX(VDATA_ADDR);
+    u32 text_pde = VM_PDE_INDEX((u32) __user_text_start);
+
+    KZEROMEM(s_kernel_directory, sizeof(s_kernel_directory));
+    KZEROMEM(s_vdata_table, sizeof(s_vdata_table));
+
+    // Identity map RAM. The directory entries allow user access so that the
+    // page table entries alone decide it.
+    for (u32 t = 0; t < VM_KERNEL_TABLES; ++t) {
+        for (u32 i = 0; i < VM_ENTRIES; ++i) {
+            u32 addr = (t * VM_ENTRIES + i) * PAGE_SIZE;
+            s_kernel_tables[t][i] = addr | VM_PRESENT | VM_WRITE;
+        }
+        s_kernel_directory[t] = (u32) s_kernel_tables[t] | VM_PRESENT |
+            VM_WRITE | VM_USER;
+    }
+
+    set_user_range(s_kernel_tables[text_pde], __user_text_start,
+        __user_text_end, 0);
+
+    // The data gets its own copy of the table, kept out of other spaces
+    s_user_data_pde = VM_PDE_INDEX((u32) __user_data_start);
+    memcpy(s_user_data_table, s_kernel_tables[s_user_data_pde],
+        sizeof(s_user_data_table));
+    set_user_range(s_user_data_table, __user_data_start, __user_data_end,
+        VM_WRITE);
+    s_kernel_directory[s_user_data_pde] = (u32) s_user_data_table |
+        VM_PRESENT | VM_WRITE | VM_USER;
+
+    // Kernel data page, read-only to user mode
+    s_vdata_table[VM_PTE_INDEX(VDATA_ADDR)] = VDATA_PHYS_ADDR | VM_PRESENT |
+        VM_USER;
+    s_kernel_directory[vdata_pde] = (u32) s_vdata_table | VM_PRESENT | VM_USER;
+
+    s_kernel_space.directory = s_kernel_directory;
+    vm_switch(&s_kernel_space);
+
+    // WP makes read-only pages read-only to the kernel as well, so that its
+    // writes to user memory take copy-on-write faults too.
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+
+    klog_info(KLOG_VM, "paging enabled, %u MiB identity mapped\n",
+        VM_RAM_SIZE >> 20);
+
+    return 0;
+}
+
+struct vm_space *vm_get_kernel_space(void)
+{
+    return &s_kernel_space;
+}
+
+struct vm_space *vm_get_current_space(void)
+{
+    return s_current;
+}
+
+int vm_space_create(struct vm_space *space)
+{
+    u32 *directory = (u32 *) frame_alloc_zeroed();
+
+    if (!directory) {
+        return KERROR_LIMIT_EXCEEDED;
+    }
+
+    // Share the kernel's tables: the identity mapping and the data page,
+    // but not the kernel's own view of .user_data
+    for (u32 i = 0; i < VM_ENTRIES; ++i) {
+        if (i == s_user_data_pde) {
+            directory[i] = (u32) s_kernel_tables[i] | VM_PRESENT | VM_WRITE |
+                VM_USER;
+        } else if (i < VM_USER_PDE_FIRST || i >= VM_USER_PDE_END) {
+            directory[i] = s_kernel_directory[i];
+        }
+    }
+
+    space->directory = directory;
+    space->region_count = 0;
+    return 0;
+}
+
+int vm_space_clone(struct vm_space *child, struct vm_space *parent)
+{
+    int result = vm_space_create(child);
+
+    if (result) {
+        return result;
+    }
+
+    for (int i = 0; i < parent->region_count; ++i) {
+        child->regions[i] = parent->regions[i];
+    }
+    child->region_count = parent->region_count;
+
+    for (u32 i = VM_USER_PDE_FIRST; i < VM_USER_PDE_END; ++i) {
+        u32 *from;
+        u32 *to;
+
+        if (!(parent->directory[i] & VM_PRESENT)) {
+            continue;
+        }
+
+        to = (u32 *) frame_alloc_zeroed();
+        if (!to) {
+            vm_space_destroy(child);
+            return KERROR_LIMIT_EXCEEDED;
+        }
+        child->directory[i] = (u32) to | VM_PRESENT | VM_WRITE | VM_USER;
+
+        from = (u32 *) VM_ENTRY_FRAME(parent->directory[i]);
+        for (u32 j = 0; j < VM_ENTRIES; ++j) {
+            u32 entry = from[j];
+
+            if (!(entry & VM_PRESENT)) {
+                continue;
+            }
+
+            if (entry & VM_OWNED) {
+                if (entry & VM_WRITE) {
+                    entry = (entry & ~VM_WRITE) | VM_COW;
+                    from[j] = entry;
+                }
+                frame_ref(VM_ENTRY_FRAME(entry));
+            }
+
+            to[j] = entry;
+        }
+    }
+
+    // Flush the parent's now read-only entries
+    if (parent == s_current) {
+        write_cr3((u32) parent->directory);
+    }
+
+    return 0;
+}
+
+void vm_space_destroy(struct vm_space *space)
+{
+    u32 *directory = space->directory;
+
+    for (u32 i = VM_USER_PDE_FIRST; i < VM_USER_PDE_END; ++i) {
+        u32 *table;
+
+        if (!(directory[i] & VM_PRESENT)) {
+            continue;
+        }
+
+        table = (u32 *) VM_ENTRY_FRAME(directory[i]);
+        for (u32 j = 0; j < VM_ENTRIES; ++j) {
+            if ((table[j] & (VM_PRESENT | VM_OWNED)) ==
+                    (VM_PRESENT | VM_OWNED)) {
+                frame_free(VM_ENTRY_FRAME(table[j]));
+            }
+        }
+        frame_free((u32) table);
+    }
+
+    frame_free((u32) directory);
+    space->directory = NULL;
+}
+
+void vm_switch(struct vm_space *space)
+{
+    s_current = space;
+    write_cr3((u32) space->directory);
+}
+
+static bool is_private_user_addr(u32 va)
+{
+    u32 pde = VM_PDE_INDEX(va);
+    return pde >= VM_USER_PDE_FIRST && pde < VM_USER_PDE_END;
+}
+
+// Makes sure there's a page table for va, which must be a private address.
+static int ensure_table(struct vm_space *space, u32 va)
+{
+    u32 *pde = &space->directory[VM_PDE_INDEX(va)];
+
+    if (!(*pde & VM_PRESENT)) {
+        u32 frame = frame_alloc_zeroed();
+
+        if (!frame) {
+            return KERROR_LIMIT_EXCEEDED;
+        }
+        *pde = frame | VM_PRESENT | VM_WRITE | VM_USER;
+    }
+
+    return 0;
+}
+
+int vm_map(struct vm_space *space, u32 va, u32 pa, u32 flags)
+{
+    u32 *table;
+    int result;
+
+    if ((va | pa) & (PAGE_SIZE - 1)) {
+        return KERROR_ARG_INVALID;
+    }
+
+    if (!is_private_user_addr(va)) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    result = ensure_table(space, va);
+    if (result) {
+        return result;
+    }
+
+    table = (u32 *) VM_ENTRY_FRAME(space->directory[VM_PDE_INDEX(va)]);
+    table[VM_PTE_INDEX(va)] = pa | VM_PRESENT | (flags & VM_FLAGS_MASK);
+
+    if (space == s_current) {
+        invlpg(va);
+    }
+
+    return 0;
+}
+
+u32 *vm_lookup(struct vm_space *space, u32 va)
+{
+    u32 pde = space->directory[VM_PDE_INDEX(va)];
+
+    if (!(pde & VM_PRESENT)) {
+        return NULL;
+    }
+
+    return &((u32 *) VM_ENTRY_FRAME(pde))[VM_PTE_INDEX(va)];
+}
+
+u32 vm_unmap(struct vm_space *space, u32 va)
+{
+    u32 *pte;
+    u32 old;
+
+    if (!is_private_user_addr(va) || !(pte = vm_lookup(space, va))) {
+        return 0;
+    }
+
+    old = *pte;
+    *pte = 0;
+
+    if (space == s_current) {
+        invlpg(va);
+    }
+
+    return old;
+}
+
+static bool is_private_user_range(u32 va, u32 count)
+{
+    u32 end = va + count * PAGE_SIZE;
+
+    return count && !(va & (PAGE_SIZE - 1)) && end > va &&
+        is_private_user_addr(va) && is_private_user_addr(end - 1);
+}
+
+static bool overlaps_region(struct vm_space *space, u32 start, u32 end)
+{
+    for (int i = 0; i < space->region_count; ++i) {
+        if (start < space->regions[i].end && space->regions[i].start < end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int vm_move_pages(struct vm_space *to, u32 to_va, struct vm_space *from,
+    u32 from_va, u32 count)
+{
+    if (!is_private_user_range(to_va, count) ||
+            !is_private_user_range(from_va, count)) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    // Check everything first, so that a failure leaves both spaces as they
+    // were. Page tables are the only thing that may be allocated.
+    for (u32 i = 0; i < count; ++i) {
+        u32 *pte = vm_lookup(from, from_va + i * PAGE_SIZE);
+        int result;
+
+        if (!pte || (*pte & (VM_PRESENT | VM_USER | VM_OWNED)) !=
+                (VM_PRESENT | VM_USER | VM_OWNED)) {
+            return KERROR_BAD_ADDRESS;
+        }
+
+        pte = vm_lookup(to, to_va + i * PAGE_SIZE);
+        if (pte && (*pte & VM_PRESENT)) {
+            return KERROR_ARG_INVALID;
+        }
+
+        result = ensure_table(to, to_va + i * PAGE_SIZE);
+        if (result) {
+            return result;
+        }
+    }
+
+    // The frames change hands as they are, COW state included
+    for (u32 i = 0; i < count; ++i) {
+        u32 entry = vm_unmap(from, from_va + i * PAGE_SIZE);
+
+        vm_map(to, to_va + i * PAGE_SIZE, VM_ENTRY_FRAME(entry),
+            entry & VM_FLAGS_MASK);
+    }
+
+    return 0;
+}
+
+int vm_add_region(struct vm_space *space, u32 start, u32 end, u32 flags,
+    const void *data, u32 data_va, u32 data_size)
+{
+    struct vm_region *region;
+
+    if ((start | end) & (PAGE_SIZE - 1) || start >= end) {
+        return KERROR_ARG_INVALID;
+    }
+
+    if (!is_private_user_addr(start) || !is_private_user_addr(end - 1)) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    if (data_size && (data_va < start || data_va + data_size > end ||
+            data_va + data_size < data_va)) {
+        return KERROR_ARG_INVALID;
+    }
+
+    if (overlaps_region(space, start, end)) {
+        return KERROR_ARG_INVALID;
+    }
+
+    if (space->region_count == VM_MAX_REGIONS) {
+        return KERROR_LIMIT_EXCEEDED;
+    }
+
+    region = &space->regions[space->region_count++];
+    region->start = start;
+    region->end = end;
+    region->flags = flags & VM_WRITE;
+    region->data = data;
+    region->data_va = data_va;
+    region->data_size = data ? data_size : 0;
+
+    return 0;
+}
+
+static struct vm_region *find_region(struct vm_space *space, u32 va)
+{
+    for (int i = 0; i < space->region_count; ++i) {
+        if (va >= space->regions[i].start && va < space->regions[i].end) {
+            return &space->regions[i];
+        }
+    }
+    return NULL;
+}
+
+// Allocates and fills the page at va from its region, and maps it.
+static int page_in(struct vm_space *space, struct vm_region *region, u32 va)
+{
+    u32 frame = frame_alloc_zeroed();
+    u32 data_end = region->data_va + region->data_size;
+    int result;
+
+    if (!frame) {
+        return KERROR_LIMIT_EXCEEDED;
+    }
+
+    // Copy the part of the backing data that overlaps this page
+    if (region->data_size && va < data_end && va + PAGE_SIZE > region->data_va) {
+        u32 from = MAX(va, region->data_va);
+        u32 to = MIN(va + PAGE_SIZE, data_end);
+
+        memcpy((u8 *) frame + (from - va),
+            region->data + (from - region->data_va), to - from);
+    }
+
+    result = vm_map(space, va, frame, VM_USER | VM_OWNED | region->flags);
+    if (result) {
+        frame_free(frame);
+    }
+
+    return result;
+}
+
+// Gives the current space a private, writable copy of a VM_COW page. The
+// last space sharing a frame just takes it over.
+static int break_cow(u32 *pte, u32 va)
+{
+    u32 old = VM_ENTRY_FRAME(*pte);
+    u32 flags = (*pte & VM_FLAGS_MASK & ~VM_COW) | VM_WRITE;
+
+    if (frame_get_refs(old) > 1) {
+        u32 frame = frame_alloc();
+
+        if (!frame) {
+            return KERROR_LIMIT_EXCEEDED;
+        }
+
+        memcpy((void *) frame, (const void *) old, PAGE_SIZE);
+        frame_free(old);
+        old = frame;
+    }
+
+    *pte = old | flags;
+    invlpg(va);
+
+    return 0;
+}
+
+int vm_handle_fault(u32 va, bool write)
+{
+    u32 *pte = is_private_user_addr(va) ? vm_lookup(s_current, va) : NULL;
+    struct vm_region *region;
+
+    if (pte && (*pte & VM_PRESENT)) {
+        if (write && (*pte & VM_COW)) {
+            return break_cow(pte, va & ~(PAGE_SIZE - 1));
+        }
+
+        // A protection fault that paging in won't fix
+        return KERROR_BAD_ADDRESS;
+    }
+
+    region = find_region(s_current, va);
+    if (!region || (write && !(region->flags & VM_WRITE))) {
+        return KERROR_BAD_ADDRESS;
+    }
+
+    return page_in(s_current, region, va & ~(PAGE_SIZE - 1));
+}
+
+bool vm_check_user(const void *ptr, size_t len, bool write)
+{
+    u32 need = VM_PRESENT | VM_USER | (write ? VM_WRITE : 0);
+    u32 start = (u32) ptr & ~(PAGE_SIZE - 1);
+    u32 end = (u32) ptr + (u32) len;
+
+    if (end < (u32) ptr) {
+        return false;
+    }
+
+    for (u32 va = start; va < end; va += PAGE_SIZE) {
+        u32 *pte;
+
+        pte = vm_lookup(s_current, va);
+        if (!pte || !(*pte & VM_PRESENT) || (write && (*pte & VM_COW))) {
+            if (vm_handle_fault(va, write)) {
+                return false;
+            }
+            pte = vm_lookup(s_current, va);
+        }
+
+        if (!(s_current->directory[VM_PDE_INDEX(va)] & VM_USER) ||
+                (*pte & need) != need) {
+            return false;
+        }
+
+        // Don't wrap around past the last page
+        if (va + PAGE_SIZE < va) {
+            break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef _INC_VM
+#define _INC_VM 1
+
+#include <stddef.h>
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+
+// Paging and address spaces.
+//
+// Every address space shares the kernel's page tables, which identity map
+// all of RAM (supervisor-only, apart from the kernel image's .user sections)
+// and the read-only kernel data page at VDATA_ADDR. The rest of user space,
+// from USER_SPACE_START up to VM_USER_TOP, is private to each space.
+
+// Page table entry flags
+#define VM_PRESENT          0x001
+#define VM_WRITE            0x002
+#define VM_USER             0x004
+#define VM_OWNED            0x200   // Frame is freed with the address space
+#define VM_COW              0x400   // Shared read-only; copied on first write
+#define VM_FLAGS_MASK       0xfff
+
+#define VM_ENTRY_FRAME(E)   ((E) & ~VM_FLAGS_MASK)
+#define VM_PDE_INDEX(VA)    ((u32) (VA) >> 22)
+#define VM_PTE_INDEX(VA)    (((u32) (VA) >> 12) & 0x3ff)
+
+// Identity mapped RAM
+#define VM_RAM_SIZE         0x01000000
+
+// End of the private part of user space. The 4MiB above it holds the kernel
+// data page, in a page table shared by every space.
+#define VM_USER_TOP         0xbfc00000
+
+// Most regions an address space can have
+#define VM_MAX_REGIONS      8
+
+// A range of user space whose pages are only allocated when first touched.
+// Each page is zero-filled, then whatever part of [data_va, data_va +
+// data_size) falls in it is copied from 'data' - so a region can back a
+// loaded segment, its .bss, or a stack.
+struct vm_region {
+    u32         start;      // Page aligned
+    u32         end;        // Page aligned, exclusive
+    u32         flags;      // VM_WRITE, or 0 for read-only
+    const u8    *data;      // Backing bytes; must outlive the space
+    u32         data_va;
+    u32         data_size;
+};
+
+struct vm_space {
+    u32 *directory;     // Page directory. Identity mapped, so also physical.
+
+    struct vm_region regions[VM_MAX_REGIONS];
+    int region_count;
+};
+
+// Builds the kernel's page tables and turns on paging.
+// Requires frame_init().
+int vm_init(void);
+
+// The address space used by the kernel when no process is running
+struct vm_space *vm_get_kernel_space(void);
+
+// The address space currently loaded in CR3
+struct vm_space *vm_get_current_space(void);
+
+// Creates an empty address space, with just the shared kernel mappings.
+int vm_space_create(struct vm_space *space);
+
+// Makes 'child' a copy-on-write clone of 'parent': it gets its own page
+// tables, but shares every owned frame, and writable pages become read-only
+// VM_COW pages in both spaces until one of them writes. Regions are copied
+// too, so untouched demand-paged pages stay untouched.
+int vm_space_clone(struct vm_space *child, struct vm_space *parent);
+
+// Frees an address space, with its page tables and VM_OWNED frames. It must
+// not be the current space.
+void vm_space_destroy(struct vm_space *space);
+
+// Loads an address space into CR3.
+void vm_switch(struct vm_space *space);
+
+// Maps the page at va to frame pa. va must be a page-aligned private user
+// address. Page tables are allocated as needed.
+int vm_map(struct vm_space *space, u32 va, u32 pa, u32 flags);
+
+// Unmaps the page at va, returning its old page table entry (0 if it was
+// not mapped). The frame is not freed.
+u32 vm_unmap(struct vm_space *space, u32 va);
+
+// Moves 'count' pages from 'from' at from_va to 'to' at to_va, by remapping
+// the frames rather than copying them. The source pages must be present and
+// owned, and the destination pages unmapped. A destination page inside a
+// region counts as touched from then on. On failure neither space is
+// changed.
+int vm_move_pages(struct vm_space *to, u32 to_va, struct vm_space *from,
+    u32 from_va, u32 count);
+
+// Returns the page table entry for va, or NULL if there is no page table
+// for it.
+u32 *vm_lookup(struct vm_space *space, u32 va);
+
+// Adds a demand-paged region covering [start, end), which must be page
+// aligned and not overlap an existing region. 'data' may be null for a
+// purely zero-filled region.
+int vm_add_region(struct vm_space *space, u32 start, u32 end, u32 flags,
+    const void *data, u32 data_va, u32 data_size);
+
+// Resolves a fault on va in the current address space, by paging in its
+// region or by breaking copy-on-write sharing. Returns 0 if the access can
+// now be retried, or an error if the access isn't allowed.
+int vm_handle_fault(u32 va, bool write);
+
+// Checks that [ptr, ptr + len) is mapped user-accessible (and writable, if
+// 'write') in the current address space, paging in any region pages that
+// haven't been touched yet and breaking copy-on-write sharing for writes.
+bool vm_check_user(const void *ptr, size_t len, bool write);
+
+#endif /* _INC_VM */
@@ -8,26 +8,29 @@
 
 static int mouse_irq_hook(int irqnum)
 {
+    int handled = IRQ_NOT_HANDLED;
+
     while (inportb(PS2_PORT_STATUS) & PS2_STATUS_INPUT_BUFFER_FULL) {
         for (int i = 0; i < 3; ++i) {
             u8 data = inportb(PS2_PORT_DATA);
             (void) data;
         }
-    }
 
-    irq_done(irqnum);
+        handled = IRQ_HANDLED;
+    }
 
-    return 0;
+    (void) irqnum;
+    return handled;
 }
 
 int mouse_init(void)
 {
-    if (irq_set_hook(12, mouse_irq_hook)) {
-        klog_printf("mouse: failed to hook irq\n");
+    if (irq_add_hook(12, mouse_irq_hook, "mouse")) {
+        klog_err(KLOG_MOUSE, "failed to hook irq\n");
         return 1;
     }
 
-    klog_printf("mouse: irq hooked\n");
+    klog_debug(KLOG_MOUSE, "irq hooked\n");
 
     ps2_set_enabled(2, 1);
 
@@ -8,6 +8,7 @@
 #include "panic.h"
 #include "kio.h"
 #include "con.h"
+#include "serial.h"
 
 static int s_panic_flags = PANIC_FULL_DUMP;
 
@@ -40,7 +41,12 @@ static INLINE NO_RETURN void __panic(const struct cpustat cs, const char *fmt,
         con_clear();
     }
 
-    klog_printf("panic: ");
+    // Get out whatever was logged before things went wrong. Interrupts may
+    // never come again, so the serial line is drained by hand.
+    klog_flush();
+    serial_flush_polled();
+
+    kprintf("panic: ");
     kvprintf(fmt, args);
 
     if (s_panic_flags & PANIC_HELP_TEXT) {
@@ -69,6 +75,10 @@ static INLINE NO_RETURN void __panic(const struct cpustat cs, const char *fmt,
             STACK_ROWS);
     }
 
+    // No more ticks to do it for us
+    con_flush();
+    serial_flush_polled();
+
     cli();
     hlt();
     while (1);
@@ -39,8 +39,8 @@ static int remap_check_offset_set(int offset)
 {
     int index = 0;
     if ((index = check_offset_set(offset)) > 0) {
-        klog_printf(
-            "pic: remap failed, bad index %d on offset %#2x (idt %#2x)\n",
+        klog_err(KLOG_PIC,
+            "remap failed, bad index %d on offset %#04x (idt %#04x)\n",
             index,
             offset,
             offset + index);
@@ -85,7 +85,8 @@ int pic_remap(int master, int slave)
     outportb(PIC_PORT_SLAVE_DATA, 0xff);
 
     // That was surprisingly painless :)
-    klog_printf("pic: remapped master to %#2x, slave to %#2x\n", master, slave);
+    klog_info(KLOG_PIC, "remapped master to %#04x, slave to %#04x\n", master,
+        slave);
 
     return 0;
 }
@@ -117,7 +118,7 @@ static INLINE u8 slave_get_mask(void)
 int pic_set_enabled(int irqnum, int enabled)
 {
     if (irqnum >= 16) {
-        klog_printf("pic: invalid irq: %d\n", irqnum);
+        klog_warn(KLOG_PIC, "invalid irq: %d\n", irqnum);
         return 1;
     }
 
@@ -134,7 +135,8 @@ int pic_set_enabled(int irqnum, int enabled)
         slave_set_mask(mask);
     }
 
-    klog_printf("pic: irq %d %s\n", irqnum, enabled ? "enabled" : "disabled");
+    klog_debug(KLOG_PIC, "irq %d %s\n", irqnum,
+        enabled ? "enabled" : "disabled");
 
     return 0;
 }
@@ -16,7 +16,7 @@ establish_pit:
 
     mov al, 00110100b
     out 0x43, al
-    mov eax, [esp+4]
+    mov eax, [esp+40]   ; rate, above the pushad/pushfd state and return address
     out 0x40, al
     mov al, ah
     out 0x40, al
@@ -1,4 +1,8 @@
 #include "pit.h"
+#include "irq.h"
+#include "vdata.h"
+#include "con.h"
+#include "kio.h"
 
 static unsigned long pit_mono_clock_ticks = 0;
 
@@ -19,6 +23,7 @@ unsigned long pit_get_ms()
 int pit_tick(int irqnum)
 {
     pit_mono_clock_ticks++;
+    vdata_tick();
     if(--next_callback_check_in <= 0) {
         for(int cb_i = 0; cb_i < 16; cb_i++) if(callbacks[cb_i].callback) {
             if(callbacks[cb_i].last_run_ticks + callbacks[cb_i].delay_ticks <= pit_mono_clock_ticks) {
@@ -33,38 +38,58 @@ int pit_tick(int irqnum)
         }
         next_callback_check_in = min_delay;
     }
-    irq_done(0);
-    return 0;
+    return IRQ_HANDLED;
 }
 
 static int h = 0;
 
+// The tick counters live on the stats console, out of the way of the log.
+// Whatever is being typed there keeps its place.
+static void show_ticks(int row)
+{
+    struct console *con = con_get(CON_STATS);
+    char text[24];
+    int x;
+    int y;
+
+    ksnprintf(text, sizeof(text), "Ticks: %d", pit_mono_clock_ticks);
+    console_get_cursor_location(con, &x, &y);
+    console_set_cursor_location(con, 60, row);
+    console_write_str(con, text);
+    console_set_cursor_location(con, x, y);
+}
+
 static unsigned long print_ticks()
 {
-    int cx, cy;
-    con_get_cursor_location(&cx, &cy);
-    con_set_cursor_location(60, 0);
-    kprintf("Ticks: %d", pit_mono_clock_ticks);
-    con_set_cursor_location(cx, cy);
+    show_ticks(0);
     return 10;
 }
 
 static unsigned long print_ticks2()
 {
-    int cx, cy;
-    con_get_cursor_location(&cx, &cy);
-    con_set_cursor_location(60, 1);
-    kprintf("Ticks: %d", pit_mono_clock_ticks);
-    con_set_cursor_location(cx, cy);
+    show_ticks(1);
     return 7;
 }
 
+int pit_add_callback(unsigned long (*callback)(void))
+{
+    for(int cb_i = 0; cb_i < 16; cb_i++) if(!callbacks[cb_i].callback) {
+        // Callback last: the PIT interrupt may look at the slot any time
+        callbacks[cb_i].delay_ticks = 0;
+        callbacks[cb_i].last_run_ticks = pit_mono_clock_ticks;
+        callbacks[cb_i].callback = callback;
+        next_callback_check_in = 1;
+        return 0;
+    }
+    return 1;
+}
+
 int pit_init(void)
 {
     callbacks[0] = (sleepable_callback_t){.delay_ticks=0, .last_run_ticks=0, .callback=&print_ticks};
     callbacks[1] = (sleepable_callback_t){.delay_ticks=0, .last_run_ticks=0, .callback=&print_ticks2};
-    establish_pit(1193);
-    irq_set_hook(0, pit_tick);
+    establish_pit(PIT_DIVISOR);
+    irq_add_hook(0, pit_tick, "pit");
     kprintf("pit: init\n");
     return 0;
 }
\ No newline at end of file
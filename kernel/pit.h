@@ -1,5 +1,14 @@
 
+// PIT input clock, and the divisor we program it with (~1kHz)
+#define PIT_BASE_HZ     1193182
+#define PIT_DIVISOR     1193
+
 void establish_pit(int rate);
 
 int pit_init(void);
+unsigned long pit_get_ms(void);
+
+// Runs callback from the PIT interrupt. The callback returns the number of
+// ticks until it should run again.
+int pit_add_callback(unsigned long (*callback)(void));
 void cpu_hlt(void);
\ No newline at end of file
@@ -0,0 +1,24 @@
+[bits 32]
+
+global proc_switch
+
+; void proc_switch(u32 *save_esp, u32 new_esp)
+; Switches kernel stacks. The caller-saved registers are already saved by the
+; C calling convention, so only the callee-saved ones need to go on the
+; stack. A new process's stack is primed by proc.c to 'return' to isr_exit.
+proc_switch:
+    mov         eax, [esp+4]                    ; save_esp
+    mov         ecx, [esp+8]                    ; new_esp
+
+    push        ebp
+    push        ebx
+    push        esi
+    push        edi
+    mov         [eax], esp
+
+    mov         esp, ecx
+    pop         edi
+    pop         esi
+    pop         ebx
+    pop         ebp
+    ret
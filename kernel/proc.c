@@ -0,0 +1,627 @@
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/ktrace.h>
+#include <kernel/kerror.h>
+#include <kernel/syscall.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpustat.h>
+
+#include "proc.h"
+#include "kio.h"
+#include "panic.h"
+#include "pit.h"
+#include "uring.h"
+#include "elf.h"
+#include "ipc.h"
+#include "user_images.h"
+#include "cpu/gdt.h"
+#include "cpu/syscall.h"
+#include "mem/frame.h"
+
+// Restores a trap frame and returns to it. Implemented in cpu/isr.asm
+extern void isr_exit(void);
+
+static struct process s_procs[PROC_MAX];
+static struct process *s_current = &s_procs[0];
+static int s_next_pid;
+
+// Set by the PIT when the running process has used up its timeslice
+static volatile bool s_need_resched;
+
+// An exited process with no parent to wait for it. Freed by whichever
+// context runs next, once we're off its stack and address space.
+static struct process *s_reap;
+
+static void free_process(struct process *p);
+
+static struct process *idle(void)
+{
+    return &s_procs[0];
+}
+
+// Round-robin over everything but process 0, which only runs when nothing
+// else can.
+static struct process *pick_next(void)
+{
+    int start = (int) (s_current - s_procs);
+
+    for (int n = 1; n <= PROC_MAX; ++n) {
+        struct process *p = &s_procs[(start + n) % PROC_MAX];
+
+        if (p == idle()) {
+            continue;
+        }
+
+        if (p->state == PROC_RUNNABLE || p->state == PROC_RUNNING) {
+            return p;
+        }
+    }
+
+    return idle();
+}
+
+// Switches to the next process, if any. Interrupts must be disabled.
+static bool schedule(void)
+{
+    struct process *prev = s_current;
+    struct process *next = pick_next();
+
+    s_need_resched = false;
+
+    if (next == prev) {
+        return false;
+    }
+
+    if (prev->state == PROC_RUNNING) {
+        prev->state = PROC_RUNNABLE;
+    }
+    next->state = PROC_RUNNING;
+
+    ktrace_printf("sched: %d -> %d\n", prev->pid, next->pid);
+
+    // usermode_call() changes the TSS stack behind our back, so process 0's
+    // is saved here rather than assumed.
+    prev->esp0 = *gdt_get_kernel_stack_slot();
+    gdt_set_kernel_stack(next->esp0);
+
+    vm_switch(next->space);
+    fpu_switch_context(next->fpu);
+
+    s_current = next;
+    proc_switch(&prev->esp, next->esp);
+
+    // Back here once something switches to prev again
+    if (s_reap) {
+        free_process(s_reap);
+        s_reap = NULL;
+    }
+
+    return true;
+}
+
+static struct process *find(int pid)
+{
+    for (int i = 0; i < PROC_MAX; ++i) {
+        if (s_procs[i].state != PROC_UNUSED && s_procs[i].pid == pid) {
+            return &s_procs[i];
+        }
+    }
+    return NULL;
+}
+
+static struct process *alloc_process(void)
+{
+    for (int i = 1; i < PROC_MAX; ++i) {
+        if (s_procs[i].state == PROC_UNUSED) {
+            return &s_procs[i];
+        }
+    }
+    return NULL;
+}
+
+// Claims a process slot and a kernel stack for a child of the current
+// process. Everything else is up to the caller.
+static struct process *create_process(const char *name)
+{
+    struct process *p;
+    u32 eflags = get_eflags();
+
+    cli();
+    p = alloc_process();
+    if (p) {
+        KZEROMEM(p, sizeof(*p));
+        p->state = PROC_CREATING;
+        p->pid = s_next_pid++;
+    }
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+
+    if (!p) {
+        return NULL;
+    }
+
+    p->name = name;
+    p->parent = s_current;
+    p->kstack = frame_alloc();
+    if (!p->kstack) {
+        free_process(p);
+        return NULL;
+    }
+    p->esp0 = p->kstack + PROC_KSTACK_SIZE;
+
+    return p;
+}
+
+// The trap frame saved on entry from ring 3, at the top of the kernel stack
+static struct isr_frame *user_frame(struct process *p)
+{
+    return (struct isr_frame *) (p->esp0 - sizeof(struct isr_frame));
+}
+
+// Resets a trap frame to enter ring 3 at 'entry' on a fresh stack.
+static void init_user_frame(struct isr_frame *frame, u32 entry, u32 user_esp)
+{
+    KZEROMEM(frame, sizeof(*frame));
+
+    frame->gs = GDT_USER_DATA_SELECTOR;
+    frame->fs = GDT_USER_DATA_SELECTOR;
+    frame->es = GDT_USER_DATA_SELECTOR;
+    frame->ds = GDT_USER_DATA_SELECTOR;
+    frame->eip = entry;
+    frame->cs = GDT_USER_CODE_SELECTOR;
+    frame->eflags = EFLAGS_IF | BITFLAG(1);     // Bit 1 is always set
+    frame->user_esp = user_esp;
+    frame->user_ss = GDT_USER_DATA_SELECTOR;
+}
+
+// Primes a new kernel stack so that the first proc_switch() to it 'returns'
+// through isr_exit into ring 3 with its user_frame().
+static void build_initial_stack(struct process *p)
+{
+    u32 *sp = (u32 *) user_frame(p);
+
+    // What proc_switch() pops: edi, esi, ebx, ebp, then the return address
+    *--sp = (u32) isr_exit;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    p->esp = (u32) sp;
+}
+
+static void free_process(struct process *p)
+{
+    // Orphan any children, and free those that have already exited
+    for (int i = 1; i < PROC_MAX; ++i) {
+        struct process *child = &s_procs[i];
+
+        if (child->state == PROC_UNUSED || child->parent != p) {
+            continue;
+        }
+
+        child->parent = NULL;
+        if (child->state == PROC_ZOMBIE) {
+            free_process(child);
+        }
+    }
+
+    uring_release_process(p);
+
+    if (p->own_space.directory) {
+        vm_space_destroy(&p->own_space);
+    }
+    if (p->kstack) {
+        frame_free(p->kstack);
+    }
+
+    KZEROMEM(p, sizeof(*p));
+}
+
+// Sets up an executable and its stack in an empty address space. Nothing is
+// mapped yet: pages of the image and stack come in as they are touched.
+static int load_image(struct vm_space *space, const void *image, size_t size,
+    u32 *entry)
+{
+    int result = elf_load(space, image, size, entry);
+
+    if (!result) {
+        result = vm_add_region(space,
+            PROC_USER_STACK_TOP - PROC_USER_STACK_SIZE, PROC_USER_STACK_TOP,
+            VM_WRITE, NULL, 0, 0);
+    }
+
+    return result;
+}
+
+int proc_exec(const char *name, const void *image, size_t size, int *pid)
+{
+    struct process *p;
+    u32 entry = 0;
+    int result;
+
+    if (!image || !size) {
+        return KERROR_ARG_INVALID;
+    }
+
+    p = create_process(name);
+    if (!p) {
+        return KERROR_LIMIT_EXCEEDED;
+    }
+
+    result = vm_space_create(&p->own_space);
+
+    if (!result) {
+        result = load_image(&p->own_space, image, size, &entry);
+    }
+
+    if (result) {
+        free_process(p);
+        return result;
+    }
+
+    p->space = &p->own_space;
+    p->fpu = &p->fpu_state;
+    fpu_context_init(p->fpu);
+    init_user_frame(user_frame(p), entry, PROC_USER_STACK_TOP);
+    build_initial_stack(p);
+
+    klog_debug(KLOG_PROC, "exec %s as pid %d (%u bytes)\n", name, p->pid, size);
+
+    if (pid) {
+        *pid = p->pid;
+    }
+
+    barrier();
+    p->state = PROC_RUNNABLE;
+
+    return 0;
+}
+
+int proc_wait(int pid, int *exit_code)
+{
+    struct process *p = find(pid);
+    u32 eflags = get_eflags();
+
+    if (!p || p->parent != s_current || p->waited) {
+        return KERROR_ARG_INVALID;
+    }
+
+    cli();
+    p->waited = true;
+
+    while (p->state != PROC_ZOMBIE) {
+        if (!schedule()) {
+            // Nothing else runnable right now, so we're the idle loop: write
+            // out the log, and sleep until an interrupt
+            sti();
+            klog_flush();
+            hlt();
+            cli();
+        }
+    }
+
+    if (exit_code) {
+        *exit_code = p->exit_code;
+    }
+
+    free_process(p);
+
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+
+    return 0;
+}
+
+int proc_fork(int *pid)
+{
+    struct process *parent = s_current;
+    struct process *p;
+    int result;
+
+    if (parent == idle()) {
+        return KERROR_ARG_INVALID;
+    }
+
+    p = create_process(parent->name);
+    if (!p) {
+        return KERROR_LIMIT_EXCEEDED;
+    }
+
+    // Only page tables are copied here; the pages themselves are shared
+    // until somebody writes to them.
+    result = vm_space_clone(&p->own_space, parent->space);
+    if (result) {
+        free_process(p);
+        return result;
+    }
+
+    p->space = &p->own_space;
+    p->fpu = &p->fpu_state;
+    fpu_context_copy(p->fpu, parent->fpu);
+
+    // The child resumes from the same system call, returning 0
+    *user_frame(p) = *user_frame(parent);
+    user_frame(p)->regset.a = 0;
+    build_initial_stack(p);
+
+    *pid = p->pid;
+
+    barrier();
+    p->state = PROC_RUNNABLE;
+
+    return 0;
+}
+
+int proc_replace(const char *name, const void *image, size_t size)
+{
+    struct process *p = s_current;
+    struct vm_space old;
+    struct vm_space space;
+    u32 entry = 0;
+    int result;
+
+    if (p == idle()) {
+        return KERROR_ARG_INVALID;
+    }
+
+    result = vm_space_create(&space);
+    if (!result) {
+        result = load_image(&space, image, size, &entry);
+        if (result) {
+            vm_space_destroy(&space);
+        }
+    }
+    if (result) {
+        return result;
+    }
+
+    // Past the point of no return: drop everything tied to the old image
+    uring_release_process(p);
+
+    old = p->own_space;
+    p->own_space = space;
+    vm_switch(p->space);
+    vm_space_destroy(&old);
+
+    fpu_context_release(p->fpu);
+    fpu_context_init(p->fpu);
+    fpu_switch_context(p->fpu);
+
+    p->name = name;
+    init_user_frame(user_frame(p), entry, PROC_USER_STACK_TOP);
+
+    klog_debug(KLOG_PROC, "pid %d is now %s\n", p->pid, name);
+
+    return 0;
+}
+
+struct process *proc_current(void)
+{
+    return s_current;
+}
+
+bool proc_yield(void)
+{
+    u32 eflags = get_eflags();
+    bool switched;
+
+    cli();
+    switched = schedule();
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+
+    return switched;
+}
+
+void proc_block(void)
+{
+    if (s_current == idle()) {
+        panic("proc: process 0 can't block\n");
+    }
+
+    s_current->state = PROC_BLOCKED;
+    schedule();
+}
+
+void proc_wake(struct process *p)
+{
+    if (p->state == PROC_BLOCKED) {
+        p->state = PROC_RUNNABLE;
+    }
+}
+
+void proc_exit(int code)
+{
+    struct process *p = s_current;
+
+    cli();
+
+    if (p == idle()) {
+        panic("proc: process 0 can't exit\n");
+    }
+
+    p->exit_code = code;
+    p->state = PROC_ZOMBIE;
+    fpu_context_release(p->fpu);
+    ipc_release_process(p);
+
+    if (!p->parent) {
+        // Only one can be pending; we're not running on the older one's
+        // stack, so it can go now
+        if (s_reap) {
+            free_process(s_reap);
+        }
+        s_reap = p;
+    }
+
+    // Zombies are never picked, so this doesn't come back. The stack and
+    // address space are freed by proc_wait(), from another context.
+    schedule();
+    panic("proc: zombie %d was scheduled\n", p->pid);
+}
+
+void proc_fault(const struct isr_frame *frame, const char *what)
+{
+    struct process *p = s_current;
+
+    if (!(frame->cs & 3) || p == idle()) {
+        return;
+    }
+
+    kprintf("proc: %s (pid %d) killed: %s at %p\n", p->name, p->pid, what,
+        (void *) frame->eip);
+    proc_exit(-1);
+}
+
+void proc_preempt(struct isr_frame *frame)
+{
+    if ((frame->cs & 3) && s_need_resched) {
+        schedule();
+    }
+}
+
+static u32 sys_exit(u32 code, u32 arg2, u32 arg3)
+{
+    (void) arg2;
+    (void) arg3;
+
+    if (s_current == idle()) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    proc_exit((int) code);
+}
+
+static u32 sys_yield(u32 arg1, u32 arg2, u32 arg3)
+{
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+
+    schedule();
+    return 0;
+}
+
+static u32 sys_fork(u32 arg1, u32 arg2, u32 arg3)
+{
+    int pid;
+    int result;
+
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+
+    result = proc_fork(&pid);
+    return result ? SYSCALL_ERROR(result) : (u32) pid;
+}
+
+static u32 sys_exec(u32 name_addr, u32 len, u32 arg3)
+{
+    const char *name = (const char *) name_addr;
+    char buffer[PROC_NAME_MAX];
+    const struct user_image *image;
+    int result;
+
+    (void) arg3;
+
+    if (!len || len >= PROC_NAME_MAX) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+    if (!syscall_user_ptr_ok(name, len)) {
+        return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    memcpy(buffer, name, len);
+    buffer[len] = '\0';
+
+    image = user_image_find(buffer);
+    if (!image) {
+        return SYSCALL_ERROR(KERROR_ARG_INVALID);
+    }
+
+    // On success, this returns 0 into the new image's entry point
+    result = proc_replace(image->name, image->start, user_image_size(image));
+    return result ? SYSCALL_ERROR(result) : 0;
+}
+
+static u32 sys_wait(u32 pid, u32 code_addr, u32 arg3)
+{
+    int *code = (int *) code_addr;
+    int exit_code;
+    int result;
+
+    (void) arg3;
+
+    if (code && !syscall_user_ptr_writable(code, sizeof(*code))) {
+        return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    result = proc_wait((int) pid, &exit_code);
+    if (result) {
+        return SYSCALL_ERROR(result);
+    }
+
+    // Checked above, but waiting may have taken a while; check again so
+    // that a copy-on-write page is broken before the write
+    if (code) {
+        if (!syscall_user_ptr_writable(code, sizeof(*code))) {
+            return SYSCALL_ERROR(KERROR_BAD_ADDRESS);
+        }
+        *code = exit_code;
+    }
+
+    return 0;
+}
+
+static u32 sys_getpid(u32 arg1, u32 arg2, u32 arg3)
+{
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+
+    return (u32) s_current->pid;
+}
+
+static unsigned long proc_pit_callback(void)
+{
+    s_need_resched = true;
+    return PROC_TIMESLICE;
+}
+
+int proc_init(void)
+{
+    int result = 0;
+    struct process *p = idle();
+
+    KZEROMEM(s_procs, sizeof(s_procs));
+
+    p->pid = 0;
+    p->name = "kernel";
+    p->state = PROC_RUNNING;
+    p->space = vm_get_kernel_space();
+    p->fpu = fpu_get_current_context();
+    s_current = p;
+    s_next_pid = 1;
+
+    result |= syscall_register(SYS_EXIT, sys_exit, "exit");
+    result |= syscall_register(SYS_YIELD, sys_yield, "yield");
+    result |= syscall_register(SYS_GETPID, sys_getpid, "getpid");
+    result |= syscall_register(SYS_FORK, sys_fork, "fork");
+    result |= syscall_register(SYS_EXEC, sys_exec, "exec");
+    result |= syscall_register(SYS_WAIT, sys_wait, "wait");
+
+    if (result || pit_add_callback(proc_pit_callback)) {
+        klog_err(KLOG_PROC, "init failed\n");
+        return 1;
+    }
+
+    klog_info(KLOG_PROC, "%d process slots, %d tick timeslice\n", PROC_MAX,
+        PROC_TIMESLICE);
+
+    return 0;
+}
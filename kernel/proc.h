@@ -0,0 +1,124 @@
+#ifndef _INC_PROC
+#define _INC_PROC 1
+
+#include <stddef.h>
+
+#include <kernel/kernel.h>
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+
+#include "cpu/fpu.h"
+#include "cpu/isr.h"
+#include "mem/page.h"
+#include "mem/vm.h"
+
+// Processes: ring 3 programs, each in its own address space with its own
+// kernel stack, scheduled round-robin.
+//
+// Process 0 is the boot context (kmain and its idle loop). It never exits
+// and only runs when nothing else can. User processes are preempted when a
+// timeslice expires; kernel code is never preempted, and only switches by
+// yielding, waiting or exiting.
+
+#define PROC_MAX                16
+#define PROC_KSTACK_SIZE        PAGE_SIZE
+
+// Timeslice, in PIT ticks
+#define PROC_TIMESLICE          10
+
+// Initial user stack. Demand-paged, so only what's used costs memory.
+#define PROC_USER_STACK_TOP     VM_USER_TOP
+#define PROC_USER_STACK_SIZE    0x00100000
+
+enum proc_state {
+    PROC_UNUSED = 0,
+    PROC_CREATING,          // Being set up by proc_exec()
+    PROC_RUNNABLE,
+    PROC_RUNNING,
+    PROC_BLOCKED,           // Waiting for proc_wake()
+    PROC_ZOMBIE,            // Exited; waiting for proc_wait()
+};
+
+// Longest program name accepted by SYS_EXEC, including the terminator
+#define PROC_NAME_MAX           32
+
+struct process {
+    int                 pid;
+    enum proc_state     state;
+    const char          *name;
+    int                 exit_code;
+
+    struct process      *parent;        // Null once orphaned
+    bool                waited;         // Parent is in proc_wait() on it
+
+    struct vm_space     *space;         // Address space in use
+    struct vm_space     own_space;      // Unused by process 0
+
+    u32                 kstack;         // Kernel stack frame; 0 for process 0
+    u32                 esp0;           // Ring 0 stack for traps from ring 3
+    u32                 esp;            // Saved kernel ESP while switched out
+
+    struct fpu_context  *fpu;
+    struct fpu_context  fpu_state;      // Unused by process 0
+
+    bool                syscall_from_user;  // See syscall_from_user()
+
+    // IPC call state (see ipc.c)
+    struct process      *ipc_next;      // Next caller queued on the endpoint
+    u32                 ipc_word;
+    u32                 ipc_grant;      // IPC_GRANT() of the pages sent
+    u32                 ipc_result;     // Reply, once woken
+};
+
+// Makes the caller process 0 and registers the process system calls.
+// Requires vm_init(), fpu_init(), syscall_init() and pit_init().
+int proc_init(void);
+
+// The running process
+struct process *proc_current(void);
+
+// Creates a process running an ELF executable (see elf_load()). The image
+// backs the process's memory, so it must outlive the process. The process
+// is runnable on return.
+int proc_exec(const char *name, const void *image, size_t size, int *pid);
+
+// Waits for child process 'pid' to exit, frees it, and returns its exit
+// code. Switches to other processes meanwhile.
+int proc_wait(int pid, int *exit_code);
+
+// Creates a copy of the current user process, sharing its memory
+// copy-on-write. The child returns 0 from the current system call.
+int proc_fork(int *pid);
+
+// Replaces the current process's image with an ELF executable (as
+// proc_exec()). On success the system call being handled returns into the
+// new image's entry point.
+int proc_replace(const char *name, const void *image, size_t size);
+
+// Lets other processes run. Returns false if there was nothing else to run.
+bool proc_yield(void);
+
+// Blocks the current process until proc_wake() is called on it.
+// Interrupts must be disabled.
+void proc_block(void);
+
+// Makes a blocked process runnable again.
+void proc_wake(struct process *p);
+
+// Ends the current process. Process 0 can't exit.
+NO_RETURN void proc_exit(int code);
+
+// Kills the current process after a CPU exception in ring 3. Returns only
+// if the fault can't be pinned on a process, in which case the caller
+// should panic.
+void proc_fault(const struct isr_frame *frame, const char *what);
+
+// Called at the end of every interrupt. Switches process if the interrupt
+// came from ring 3 and the timeslice is up.
+void proc_preempt(struct isr_frame *frame);
+
+// Saves callee-saved registers and ESP into *save_esp, then resumes the
+// context saved at new_esp. Implemented in proc.asm
+void CDECL proc_switch(u32 *save_esp, u32 new_esp);
+
+#endif /* _INC_PROC */
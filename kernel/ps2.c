@@ -54,8 +54,8 @@ int ps2_set_enabled(int chnum, int enabled)
 
     ps2_set_config(ps2_config);
 
-    klog_printf(
-        "ps2: channel %d %s\n",
+    klog_debug(KLOG_PS2,
+        "channel %d %s\n",
         chnum,
         enabled ? "enabled" : "disabled");
 
@@ -68,7 +68,7 @@ int ps2_disable_scancode_translation(void)
     ps2_config &= ~PS2_CONFIG_CH1_TRANSLATION;
     ps2_set_config(ps2_config);
 
-    klog_printf("ps2: scancode translation disabled\n");
+    klog_debug(KLOG_PS2, "scancode translation disabled\n");
 
     return 0;
 }
@@ -231,7 +231,7 @@ static ALWAYS_INLINE int __wait_for_output_buffer(void)
 #define FLUSH_INPUT_BUFFER()                                                \
     {                                                                       \
         if (__flush_input_buffer()) {                                       \
-            klog_printf("ps2: input buffer flush failed (%s:%d)\n",         \
+            klog_warn(KLOG_PS2, "input buffer flush failed (%s:%d)\n",      \
                 __FILE__, __LINE__);                                        \
         }                                                                   \
     }
@@ -240,7 +240,7 @@ static ALWAYS_INLINE int __wait_for_output_buffer(void)
 #define WAIT_FOR_OUTPUT_BUFFER()                                            \
     {                                                                       \
         if (__wait_for_output_buffer()) {                                   \
-            klog_printf("ps2: output buffer wait failed (%s:%d)\n",         \
+            klog_warn(KLOG_PS2, "output buffer wait failed (%s:%d)\n",      \
                 __FILE__, __LINE__);                                        \
         }                                                                   \
     }
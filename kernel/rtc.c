@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kerror.h>
+#include <kernel/asm/portio.h>
+
+#include "rtc.h"
+
+// Spins at most this many reads waiting for an update to finish. Updates
+// take under 2ms, so this is generous.
+#define RTC_UPDATE_SPINS    100000
+
+struct rtc_time {
+    u8 second;
+    u8 minute;
+    u8 hour;
+    u8 day;
+    u8 month;
+    u8 year;
+};
+
+static u8 read_reg(u8 reg)
+{
+    outportb(RTC_PORT_INDEX, reg);
+    return inportb(RTC_PORT_DATA);
+}
+
+static bool wait_for_update(void)
+{
+    for (int i = 0; i < RTC_UPDATE_SPINS; ++i) {
+        if (!(read_reg(RTC_REG_STATUS_A) & RTC_STATUS_A_UPDATING)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void read_time(struct rtc_time *time)
+{
+    time->second = read_reg(RTC_REG_SECONDS);
+    time->minute = read_reg(RTC_REG_MINUTES);
+    time->hour = read_reg(RTC_REG_HOURS);
+    time->day = read_reg(RTC_REG_DAY);
+    time->month = read_reg(RTC_REG_MONTH);
+    time->year = read_reg(RTC_REG_YEAR);
+}
+
+static INLINE u8 from_bcd(u8 value)
+{
+    return (u8) ((value >> 4) * 10 + (value & 0x0f));
+}
+
+// Days from 1970-01-01 to the given date (proleptic Gregorian calendar)
+static u32 days_since_epoch(u32 year, u32 month, u32 day)
+{
+    // Count years from March, so the leap day is the last day of the year
+    u32 y = (month <= 2) ? year - 1 : year;
+    u32 era = y / 400;
+    u32 yoe = y - era * 400;
+    u32 mp = (month > 2) ? month - 3 : month + 9;
+    u32 doy = (153 * mp + 2) / 5 + day - 1;
+    u32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+int rtc_read_unix_time(u64 *seconds)
+{
+    struct rtc_time time;
+    struct rtc_time check;
+    u8 status;
+    u32 hour;
+    u32 days;
+
+    // Read until two consecutive reads agree, so we never see a value that
+    // changed half way through.
+    do {
+        if (!wait_for_update()) {
+            return KERROR_HARDWARE_PORT;
+        }
+        read_time(&time);
+
+        if (!wait_for_update()) {
+            return KERROR_HARDWARE_PORT;
+        }
+        read_time(&check);
+    } while (memcmp(&time, &check, sizeof(time)) != 0);
+
+    status = read_reg(RTC_REG_STATUS_B);
+    hour = time.hour & ~RTC_HOURS_PM;
+
+    if (!(status & RTC_STATUS_B_BINARY)) {
+        time.second = from_bcd(time.second);
+        time.minute = from_bcd(time.minute);
+        hour = from_bcd((u8) hour);
+        time.day = from_bcd(time.day);
+        time.month = from_bcd(time.month);
+        time.year = from_bcd(time.year);
+    }
+
+    if (!(status & RTC_STATUS_B_24_HOUR)) {
+        // 12 hour mode: 12am is hour 0, 12pm is hour 12
+        hour %= 12;
+        if (time.hour & RTC_HOURS_PM) {
+            hour += 12;
+        }
+    }
+
+    if (time.month < 1 || time.month > 12 || time.day < 1 || time.day > 31) {
+        return KERROR_ARG_OUT_OF_RANGE;
+    }
+
+    days = days_since_epoch(2000 + time.year, time.month, time.day);
+    *seconds = (u64) days * 86400 + hour * 3600 + time.minute * 60 +
+        time.second;
+
+    return 0;
+}
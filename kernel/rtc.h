@@ -0,0 +1,29 @@
+#ifndef _INC_RTC
+#define _INC_RTC 1
+
+#include <kernel/types.h>
+
+// RTC - the CMOS real-time clock
+#define RTC_PORT_INDEX          0x70
+#define RTC_PORT_DATA           0x71
+
+// CMOS registers
+#define RTC_REG_SECONDS         0x00
+#define RTC_REG_MINUTES         0x02
+#define RTC_REG_HOURS           0x04
+#define RTC_REG_DAY             0x07
+#define RTC_REG_MONTH           0x08
+#define RTC_REG_YEAR            0x09
+#define RTC_REG_STATUS_A        0x0a
+#define RTC_REG_STATUS_B        0x0b
+
+#define RTC_STATUS_A_UPDATING   0x80 // Update in progress; values unstable
+#define RTC_STATUS_B_24_HOUR    0x02
+#define RTC_STATUS_B_BINARY     0x04 // Values are binary rather than BCD
+#define RTC_HOURS_PM            0x80 // In 12 hour mode
+
+// Reads the current time as seconds since the Unix epoch. Assumes the RTC
+// holds UTC and a year in 2000-2099.
+int rtc_read_unix_time(u64 *seconds);
+
+#endif /* _INC_RTC */
@@ -0,0 +1,168 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/asm/misc.h>
+#include <kernel/asm/cpustat.h>
+#include <kernel/asm/portio.h>
+
+#include "serial.h"
+#include "irq.h"
+
+#define SERIAL_TX_MASK      (SERIAL_TX_RING_SIZE - 1)
+
+#define COM1(reg)           (SERIAL_COM1_PORT + SERIAL_REG_##reg)
+
+// Transmit ring. Writers advance the head and the interrupt handler the tail,
+// both with interrupts disabled.
+static u8 s_tx_ring[SERIAL_TX_RING_SIZE];
+static u32 s_tx_head;
+static u32 s_tx_tail;
+
+// Whether the THRE interrupt is enabled, i.e. the FIFO is being refilled
+static bool s_tx_busy;
+
+static bool s_present;
+static u32 s_dropped;
+
+// Moves up to a FIFO's worth of bytes from the ring to the UART. Called only
+// when the FIFO is empty. Returns the number of bytes sent.
+static int fill_fifo(void)
+{
+    int count = 0;
+
+    while (count < SERIAL_TX_FIFO_SIZE && s_tx_tail != s_tx_head) {
+        outportb(COM1(DATA), s_tx_ring[s_tx_tail & SERIAL_TX_MASK]);
+        ++s_tx_tail;
+        ++count;
+    }
+
+    return count;
+}
+
+static int serial_irq_hook(int irqnum)
+{
+    int handled = IRQ_NOT_HANDLED;
+    u8 iir;
+
+    (void) irqnum;
+
+    while (!((iir = inportb(COM1(IIR))) & SERIAL_IIR_NO_PENDING)) {
+        // The FIFO has drained; refill it, or stop once the ring is empty
+        if ((iir & SERIAL_IIR_ID_MASK) == SERIAL_IIR_ID_THRE && !fill_fifo()) {
+            s_tx_busy = false;
+            outportb(COM1(IER), 0);
+        }
+        handled = IRQ_HANDLED;
+    }
+
+    return handled;
+}
+
+static INLINE void queue_byte(u8 c)
+{
+    if (s_tx_head - s_tx_tail >= SERIAL_TX_RING_SIZE) {
+        ++s_dropped;
+        return;
+    }
+    s_tx_ring[s_tx_head++ & SERIAL_TX_MASK] = c;
+}
+
+void serial_write(const char *str, size_t len)
+{
+    u32 eflags;
+
+    if (!s_present) {
+        return;
+    }
+
+    eflags = get_eflags();
+    cli();
+
+    for (size_t i = 0; i < len; ++i) {
+        if (str[i] == '\n') {
+            queue_byte('\r');
+        }
+        queue_byte((u8) str[i]);
+    }
+
+    // The UART raises THRE as soon as it is enabled with the FIFO empty, so
+    // the handler does all the sending. If it's already enabled, the handler
+    // picks the new bytes up at the next refill.
+    if (!s_tx_busy && s_tx_head != s_tx_tail) {
+        s_tx_busy = true;
+        outportb(COM1(IER), SERIAL_IER_THRE);
+    }
+
+    if (eflags & EFLAGS_IF) {
+        sti();
+    }
+}
+
+static void serial_sink_put(struct kio_sink *sink, const char *str,
+    size_t len)
+{
+    (void) sink;
+    serial_write(str, len);
+}
+
+struct kio_sink serial_sink = { serial_sink_put };
+
+void serial_flush_polled(void)
+{
+    if (!s_present) {
+        return;
+    }
+
+    outportb(COM1(IER), 0);
+    s_tx_busy = false;
+
+    while (s_tx_tail != s_tx_head) {
+        while (!(inportb(COM1(LSR)) & SERIAL_LSR_THRE)) {
+        }
+        fill_fifo();
+    }
+}
+
+u32 serial_get_dropped(void)
+{
+    return s_dropped;
+}
+
+int serial_init(void)
+{
+    u16 divisor = SERIAL_CLOCK_HZ / SERIAL_BAUD;
+
+    // No UART behind the port reads back all ones and ignores writes
+    outportb(COM1(SCRATCH), 0x5a);
+    if (inportb(COM1(SCRATCH)) != 0x5a) {
+        klog_warn(KLOG_SERIAL, "no uart at %#05x\n", SERIAL_COM1_PORT);
+        return 1;
+    }
+
+    outportb(COM1(IER), 0);
+    outportb(COM1(LCR), SERIAL_LCR_DLAB);
+    outportb(COM1(DIVISOR_LO), (u8) divisor);
+    outportb(COM1(DIVISOR_HI), (u8) (divisor >> 8));
+    outportb(COM1(LCR), SERIAL_LCR_8N1);
+    outportb(COM1(FCR), SERIAL_FCR_ENABLE | SERIAL_FCR_CLEAR_RX |
+        SERIAL_FCR_CLEAR_TX | SERIAL_FCR_TRIGGER_14);
+    outportb(COM1(MCR), SERIAL_MCR_DTR | SERIAL_MCR_RTS | SERIAL_MCR_OUT2);
+
+    if (irq_add_hook(SERIAL_COM1_IRQ, serial_irq_hook, "serial")) {
+        klog_err(KLOG_SERIAL, "failed to hook irq\n");
+        return 1;
+    }
+
+    s_present = true;
+
+    if (klog_add_sink(&serial_sink)) {
+        klog_err(KLOG_SERIAL, "failed to add log sink\n");
+        s_present = false;
+        irq_remove_hook(SERIAL_COM1_IRQ, serial_irq_hook);
+        return 1;
+    }
+
+    klog_info(KLOG_SERIAL, "com1 at %#05x, %d baud\n", SERIAL_COM1_PORT,
+        SERIAL_BAUD);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _INC_SERIAL
+#define _INC_SERIAL 1
+
+#include <stddef.h>
+
+#include <kernel/types.h>
+
+// For struct kio_sink
+#include "kio.h"
+
+// 16550 UART on COM1, used as a write-only console for the kernel log.
+//
+// Output is queued in a ring buffer and sent from the transmitter-empty
+// interrupt, a FIFO's worth of bytes at a time, so writers never wait on the
+// line. If the ring fills up, further bytes are dropped and counted.
+
+#define SERIAL_COM1_PORT        0x3f8
+#define SERIAL_COM1_IRQ         4
+
+// Register offsets from the base port
+#define SERIAL_REG_DATA         0   // THR on write, RBR on read
+#define SERIAL_REG_IER          1   // Interrupt enable
+#define SERIAL_REG_DIVISOR_LO   0   // With LCR_DLAB set
+#define SERIAL_REG_DIVISOR_HI   1   // With LCR_DLAB set
+#define SERIAL_REG_IIR          2   // Interrupt identification, on read
+#define SERIAL_REG_FCR          2   // FIFO control, on write
+#define SERIAL_REG_LCR          3   // Line control
+#define SERIAL_REG_MCR          4   // Modem control
+#define SERIAL_REG_LSR          5   // Line status
+#define SERIAL_REG_SCRATCH      7
+
+#define SERIAL_IER_THRE         0x02 // Transmit holding register empty
+
+#define SERIAL_IIR_NO_PENDING   0x01
+#define SERIAL_IIR_ID_MASK      0x0e
+#define SERIAL_IIR_ID_THRE      0x02
+
+#define SERIAL_FCR_ENABLE       0x01
+#define SERIAL_FCR_CLEAR_RX     0x02
+#define SERIAL_FCR_CLEAR_TX     0x04
+#define SERIAL_FCR_TRIGGER_14   0xc0
+
+#define SERIAL_LCR_8N1          0x03
+#define SERIAL_LCR_DLAB         0x80 // Divisor latch access
+
+#define SERIAL_MCR_DTR          0x01
+#define SERIAL_MCR_RTS          0x02
+#define SERIAL_MCR_OUT2         0x08 // Gates the UART's IRQ line on PCs
+
+#define SERIAL_LSR_THRE         0x20
+
+// The UART's clock, divided down to the baud rate
+#define SERIAL_CLOCK_HZ         115200
+#define SERIAL_BAUD             115200
+
+// Depth of the 16550A transmit FIFO
+#define SERIAL_TX_FIFO_SIZE     16
+
+// Bytes queued for sending. Must be a power of two.
+#define SERIAL_TX_RING_SIZE     4096
+
+// Probes and programs COM1, hooks its IRQ, and adds it as a klog sink.
+// Returns non-zero if there is no UART.
+int serial_init(void);
+
+// Queues 'len' chars for sending, translating "\n" to "\r\n"
+void serial_write(const char *str, size_t len);
+
+// Writes to COM1, for kvfprintf() and klog
+extern struct kio_sink serial_sink;
+
+// Sends everything queued by polling the line status, for when interrupts
+// are off for good, i.e. on panic.
+void serial_flush_polled(void);
+
+// Bytes dropped because the transmit ring was full
+u32 serial_get_dropped(void);
+
+#endif /* _INC_SERIAL */
@@ -0,0 +1,375 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/kerror.h>
+#include <kernel/asm/misc.h>
+
+#include "uring.h"
+#include "kio.h"
+#include "pit.h"
+#include "proc.h"
+#include "mem/vm.h"
+#include "cpu/syscall.h"
+
+#define URING_ERROR(KERROR) ((s32) -(KERROR))
+
+struct uring_slot {
+    struct uring    *ring;          // Null if the slot is free
+    bool            from_user;      // Privilege of the registering caller
+    struct process  *owner;         // Whose address space ring lives in
+
+    // Checked at setup. The caller can rewrite the copy in the ring header,
+    // so the kernel only ever uses these.
+    u32             entries;
+    struct uring_sqe *sqes;
+    struct uring_cqe *cqes;
+};
+
+// A sleep waiting for its deadline
+struct uring_timer {
+    int             ring_id;        // -1 if the timer is free
+    u32             user_data;
+    unsigned long   deadline;       // In PIT ticks
+};
+
+static struct uring_slot s_rings[URING_MAX_RINGS];
+static struct uring_timer s_timers[URING_MAX_TIMERS];
+static int s_first_ring;
+
+// Both the PIT callback and the system calls run with interrupts disabled,
+// so nothing here needs further locking.
+
+static void release(int id)
+{
+    // Outstanding sleeps are dropped without completing
+    for (int i = 0; i < URING_MAX_TIMERS; ++i) {
+        if (s_timers[i].ring_id == id) {
+            s_timers[i].ring_id = -1;
+        }
+    }
+
+    s_rings[id].ring = NULL;
+    s_rings[id].owner = NULL;
+}
+
+// The owner can unmap or protect its ring at any time, and a fault here
+// would take down the kernel, so the ring is checked before every use. A
+// ring that has gone away is dropped. The owner's space must be loaded.
+static bool check_ring(int id)
+{
+    const struct uring_slot *slot = &s_rings[id];
+
+    if (syscall_ptr_writable_for(slot->ring, URING_SIZE(slot->entries),
+            slot->from_user)) {
+        return true;
+    }
+
+    klog_warn(KLOG_URING, "ring %d is no longer mapped, dropping it\n", id);
+    release(id);
+    return false;
+}
+
+static bool cq_full(const struct uring_slot *slot)
+{
+    const struct uring *ring = slot->ring;
+    return (ring->cq_tail - ring->cq_head) >= slot->entries;
+}
+
+static void post_completion(const struct uring_slot *slot, u32 user_data,
+    s32 result)
+{
+    struct uring *ring = slot->ring;
+    struct uring_cqe *cqe;
+
+    if (cq_full(slot)) {
+        ++ring->overflow;
+        return;
+    }
+
+    cqe = &slot->cqes[ring->cq_tail & (slot->entries - 1)];
+    cqe->user_data = user_data;
+    cqe->result = result;
+
+    // The entry must be visible before the caller can see the new tail
+    barrier();
+    ++ring->cq_tail;
+}
+
+static s32 op_write(const struct uring_slot *slot, const struct uring_sqe *sqe)
+{
+    const char *str = (const char *) sqe->addr;
+    u32 len = MIN(sqe->len, URING_MAX_WRITE);
+
+    if (!syscall_ptr_ok_for(str, len, slot->from_user)) {
+        return URING_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    // This can run from the timer interrupt, so it is kept short
+    kio_out_sink.put(&kio_out_sink, str, len);
+
+    return (s32) len;
+}
+
+// Returns true if the sleep was queued, in which case it completes later.
+static bool op_sleep(int ring_id, const struct uring_sqe *sqe, s32 *result)
+{
+    for (int i = 0; i < URING_MAX_TIMERS; ++i) {
+        struct uring_timer *timer = &s_timers[i];
+
+        if (timer->ring_id >= 0) {
+            continue;
+        }
+
+        // One PIT tick is ~1ms
+        timer->ring_id = ring_id;
+        timer->user_data = sqe->user_data;
+        timer->deadline = pit_get_ms() + sqe->len;
+        return true;
+    }
+
+    *result = URING_ERROR(KERROR_LIMIT_EXCEEDED);
+    return false;
+}
+
+// Executes one submission. Returns false if it will complete later.
+static bool execute(int ring_id, const struct uring_sqe *sqe, s32 *result)
+{
+    const struct uring_slot *slot = &s_rings[ring_id];
+
+    switch (sqe->opcode) {
+        case URING_OP_NOP:
+            *result = 0;
+            return true;
+
+        case URING_OP_WRITE:
+            *result = op_write(slot, sqe);
+            return true;
+
+        case URING_OP_READ:
+            // There is no disk driver yet
+            *result = URING_ERROR(KERROR_NOT_IMPLEMENTED);
+            return true;
+
+        case URING_OP_SLEEP:
+            return !op_sleep(ring_id, sqe, result);
+
+        default:
+            *result = URING_ERROR(KERROR_ARG_INVALID);
+            return true;
+    }
+}
+
+// Consumes up to 'budget' submissions. Returns how many were consumed.
+static int drain(int ring_id, int budget)
+{
+    const struct uring_slot *slot = &s_rings[ring_id];
+    struct uring *ring = slot->ring;
+    int consumed = 0;
+
+    // Stop while the completion queue is full rather than lose completions;
+    // the caller will reap some and we'll pick up from here.
+    while (consumed < budget && ring->sq_head != ring->sq_tail &&
+            !cq_full(slot)) {
+        struct uring_sqe sqe;
+        s32 result;
+
+        // Copy the entry first, so the caller can't change it under us
+        barrier();
+        sqe = slot->sqes[ring->sq_head & (slot->entries - 1)];
+        barrier();
+        ++ring->sq_head;
+        ++consumed;
+
+        if (execute(ring_id, &sqe, &result)) {
+            post_completion(slot, sqe.user_data, result);
+        }
+    }
+
+    return consumed;
+}
+
+static void expire_timer(struct uring_timer *timer)
+{
+    if ((long) (pit_get_ms() - timer->deadline) < 0) {
+        return;
+    }
+
+    post_completion(&s_rings[timer->ring_id], timer->user_data, 0);
+    timer->ring_id = -1;
+}
+
+int uring_poll(void)
+{
+    struct vm_space *space = vm_get_current_space();
+    int consumed = 0;
+
+    // Rings are only reachable in their owner's address space, so borrow it
+    // for the duration. The first ring served rotates, so that one busy ring
+    // can't use up the budget on every tick.
+    for (int n = 0; n < URING_MAX_RINGS; ++n) {
+        int i = (s_first_ring + n) % URING_MAX_RINGS;
+        struct vm_space *owner_space;
+
+        if (!s_rings[i].ring) {
+            continue;
+        }
+
+        owner_space = s_rings[i].owner->space;
+        if (owner_space != vm_get_current_space()) {
+            vm_switch(owner_space);
+        }
+
+        if (check_ring(i)) {
+            consumed += drain(i, URING_POLL_BUDGET - consumed);
+        }
+    }
+    s_first_ring = (s_first_ring + 1) % URING_MAX_RINGS;
+
+    // Timers post into their rings too
+    for (int i = 0; i < URING_MAX_TIMERS; ++i) {
+        struct uring_timer *timer = &s_timers[i];
+        struct vm_space *owner_space;
+
+        if (timer->ring_id < 0) {
+            continue;
+        }
+
+        owner_space = s_rings[timer->ring_id].owner->space;
+        if (owner_space != vm_get_current_space()) {
+            vm_switch(owner_space);
+        }
+
+        if (check_ring(timer->ring_id)) {
+            expire_timer(timer);
+        }
+    }
+
+    if (space != vm_get_current_space()) {
+        vm_switch(space);
+    }
+
+    return consumed;
+}
+
+void uring_release_process(struct process *p)
+{
+    for (int i = 0; i < URING_MAX_RINGS; ++i) {
+        if (s_rings[i].ring && s_rings[i].owner == p) {
+            release(i);
+        }
+    }
+}
+
+bool uring_in_range(const struct process *p, u32 va, u32 size)
+{
+    for (int i = 0; i < URING_MAX_RINGS; ++i) {
+        const struct uring_slot *slot = &s_rings[i];
+        u32 start = (u32) slot->ring;
+
+        if (slot->ring && slot->owner == p && start < va + size &&
+                va < start + URING_SIZE(slot->entries)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_valid_id(u32 id)
+{
+    return id < URING_MAX_RINGS && s_rings[id].ring;
+}
+
+static u32 sys_uring_setup(u32 ring_addr, u32 entries, u32 arg3)
+{
+    struct uring *ring = (struct uring *) ring_addr;
+
+    (void) arg3;
+
+    if (!entries || entries > URING_MAX_ENTRIES || (entries & (entries - 1))) {
+        return (u32) URING_ERROR(KERROR_ARG_OUT_OF_RANGE);
+    }
+
+    if (!syscall_user_ptr_writable(ring, URING_SIZE(entries))) {
+        return (u32) URING_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    for (int i = 0; i < URING_MAX_RINGS; ++i) {
+        if (s_rings[i].ring) {
+            continue;
+        }
+
+        ring->sq_head = 0;
+        ring->sq_tail = 0;
+        ring->cq_head = 0;
+        ring->cq_tail = 0;
+        ring->entries = entries;
+        ring->overflow = 0;
+
+        s_rings[i].ring = ring;
+        s_rings[i].from_user = syscall_from_user();
+        s_rings[i].owner = proc_current();
+        s_rings[i].entries = entries;
+        s_rings[i].sqes = (struct uring_sqe *) (ring + 1);
+        s_rings[i].cqes = (struct uring_cqe *) (s_rings[i].sqes + entries);
+        return (u32) i;
+    }
+
+    return (u32) URING_ERROR(KERROR_LIMIT_EXCEEDED);
+}
+
+static u32 sys_uring_enter(u32 id, u32 arg2, u32 arg3)
+{
+    (void) arg2;
+    (void) arg3;
+
+    if (!is_valid_id(id) || s_rings[id].owner != proc_current()) {
+        return (u32) URING_ERROR(KERROR_ARG_INVALID);
+    }
+
+    if (!check_ring((int) id)) {
+        return (u32) URING_ERROR(KERROR_BAD_ADDRESS);
+    }
+
+    // The caller asked for this, so it gets a whole ring's worth
+    return (u32) drain((int) id, (int) s_rings[id].entries);
+}
+
+static u32 sys_uring_destroy(u32 id, u32 arg2, u32 arg3)
+{
+    (void) arg2;
+    (void) arg3;
+
+    if (!is_valid_id(id) || s_rings[id].owner != proc_current()) {
+        return (u32) URING_ERROR(KERROR_ARG_INVALID);
+    }
+
+    release((int) id);
+    return 0;
+}
+
+static unsigned long uring_pit_callback(void)
+{
+    uring_poll();
+    return 1;
+}
+
+int uring_init(void)
+{
+    int result = 0;
+
+    KZEROMEM(s_rings, sizeof(s_rings));
+    for (int i = 0; i < URING_MAX_TIMERS; ++i) {
+        s_timers[i].ring_id = -1;
+    }
+
+    result |= syscall_register(SYS_URING_SETUP, sys_uring_setup, "uring_setup");
+    result |= syscall_register(SYS_URING_ENTER, sys_uring_enter, "uring_enter");
+    result |= syscall_register(SYS_URING_DESTROY, sys_uring_destroy,
+        "uring_destroy");
+
+    if (result || pit_add_callback(uring_pit_callback)) {
+        klog_err(KLOG_URING, "init failed\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef _INC_URING
+#define _INC_URING 1
+
+#include <kernel/uring.h>
+
+// Kernel side of the asynchronous system call rings (see <kernel/uring.h>).
+
+// Most rings registered at once
+#define URING_MAX_RINGS         4
+
+// Largest queue size accepted by SYS_URING_SETUP
+#define URING_MAX_ENTRIES       256
+
+// Most sleeps in flight across all rings
+#define URING_MAX_TIMERS        32
+
+// Most bytes one URING_OP_WRITE puts out; longer writes complete short
+#define URING_MAX_WRITE         256
+
+// Most submissions consumed per PIT tick, across all rings
+#define URING_POLL_BUDGET       16
+
+struct process;
+
+// Registers the uring system calls and starts polling from the PIT.
+// Requires syscall_init(), pit_init() and proc_init().
+int uring_init(void);
+
+// Drains registered submission queues, up to URING_POLL_BUDGET submissions
+// in all, and completes expired sleeps. Returns the number of submissions
+// consumed.
+int uring_poll(void);
+
+// Unregisters every ring owned by p. Called when p is freed.
+void uring_release_process(struct process *p);
+
+// Returns true if any ring owned by p lies in [va, va + size). Pages behind
+// a ring must stay where they are for as long as it is registered.
+bool uring_in_range(const struct process *p, u32 va, u32 size);
+
+#endif /* _INC_URING */
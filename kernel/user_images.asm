@@ -0,0 +1,20 @@
+[bits 32]
+
+; User programs (ELF executables) embedded in the kernel image, until there's
+; a filesystem to load them from. Built by user/Makefile; listed in
+; user_images.c.
+
+%macro USER_IMAGE 2
+global user_image_%1_start
+global user_image_%1_end
+user_image_%1_start:
+    incbin      %2
+user_image_%1_end:
+%endmacro
+
+    [section .rodata]
+
+    align       4
+    USER_IMAGE  hello, "../user/hello.elf"
+    USER_IMAGE  forktest, "../user/forktest.elf"
+    USER_IMAGE  ipcbench, "../user/ipcbench.elf"
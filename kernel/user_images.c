@@ -0,0 +1,32 @@
+#include <string.h>
+
+#include <kernel/kernel.h>
+
+#include "user_images.h"
+
+// Defined in user_images.asm
+extern const u8 user_image_hello_start[];
+extern const u8 user_image_hello_end[];
+extern const u8 user_image_forktest_start[];
+extern const u8 user_image_forktest_end[];
+extern const u8 user_image_ipcbench_start[];
+extern const u8 user_image_ipcbench_end[];
+
+static const struct user_image s_images[] = {
+    { "hello", user_image_hello_start, user_image_hello_end },
+    { "forktest", user_image_forktest_start, user_image_forktest_end },
+    { "ipcbench", user_image_ipcbench_start, user_image_ipcbench_end },
+};
+
+#define IMAGE_COUNT (sizeof(s_images) / sizeof(s_images[0]))
+
+const struct user_image *user_image_find(const char *name)
+{
+    for (size_t i = 0; i < IMAGE_COUNT; ++i) {
+        if (!strcmp(s_images[i].name, name)) {
+            return &s_images[i];
+        }
+    }
+
+    return NULL;
+}
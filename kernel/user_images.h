@@ -0,0 +1,24 @@
+#ifndef _INC_USER_IMAGES
+#define _INC_USER_IMAGES 1
+
+#include <stddef.h>
+
+#include <kernel/types.h>
+#include <kernel/compiler.h>
+
+// Program images built into the kernel (see user_images.asm)
+struct user_image {
+    const char  *name;
+    const u8    *start;
+    const u8    *end;
+};
+
+// Looks up a built-in program by name. Returns null if there's none.
+const struct user_image *user_image_find(const char *name);
+
+static INLINE size_t user_image_size(const struct user_image *image)
+{
+    return (size_t) (image->end - image->start);
+}
+
+#endif /* _INC_USER_IMAGES */
@@ -0,0 +1,135 @@
+#include <kernel/kernel.h>
+#include <kernel/klog.h>
+#include <kernel/asm/misc.h>
+
+#include "vdata.h"
+#include "pit.h"
+#include "rtc.h"
+#include "cpu/syscall.h"
+
+// The TSC is calibrated against this many ticks, starting a few ticks after
+// boot to stay clear of start-up noise.
+#define VDATA_CALIBRATE_START   10
+#define VDATA_CALIBRATE_TICKS   100
+
+// Length of a PIT tick, folded at compile time
+#define VDATA_TICK_NS   ((u32) (PIT_DIVISOR * 1000000000ULL / PIT_BASE_HZ))
+#define VDATA_TICK_HZ   ((PIT_BASE_HZ + PIT_DIVISOR / 2) / PIT_DIVISOR)
+
+static u64 s_calibrate_tsc;
+static bool s_calibrate_failed;
+
+// Set once the page holds valid data
+static bool s_ready;
+
+static INLINE struct vdata *page(void)
+{
+    return (struct vdata *) VDATA_PHYS_ADDR;
+}
+
+// Start and end of a seqlock write section. Only the timer interrupt
+// writes, so writers never race each other.
+static INLINE void write_begin(struct vdata *vdata)
+{
+    ++vdata->seq;
+    barrier();
+}
+
+static INLINE void write_end(struct vdata *vdata)
+{
+    barrier();
+    ++vdata->seq;
+}
+
+static void calibrate_tsc(struct vdata *vdata, u64 tsc)
+{
+    u64 cycles;
+
+    if (vdata->ticks == VDATA_CALIBRATE_START) {
+        s_calibrate_tsc = tsc;
+        return;
+    }
+
+    if (vdata->ticks != VDATA_CALIBRATE_START + VDATA_CALIBRATE_TICKS) {
+        return;
+    }
+
+    // Logged by vdata_tick() outside the write section, as klog timestamps
+    // read the page
+    cycles = tsc - s_calibrate_tsc;
+    if (!cycles || (cycles >> 32)) {
+        s_calibrate_failed = true;
+        return;
+    }
+
+    // mult = (ns elapsed << shift) / cycles elapsed
+    vdata->tsc_mult = (u32) div_u64_u32(
+        ((u64) VDATA_TICK_NS * VDATA_CALIBRATE_TICKS) << VDATA_TSC_SHIFT,
+        (u32) cycles, NULL);
+}
+
+int vdata_init(void)
+{
+    struct vdata *vdata = page();
+    u64 wall_sec = 0;
+
+    KZEROMEM(vdata, sizeof(*vdata));
+
+    if (rtc_read_unix_time(&wall_sec)) {
+        klog_warn(KLOG_VDATA, "could not read the real-time clock\n");
+    }
+
+    vdata->tick_hz = VDATA_TICK_HZ;
+    vdata->tick_ns = VDATA_TICK_NS;
+    vdata->wall_sec = wall_sec;
+    vdata->tick_tsc = rdtsc();
+    vdata->sysenter_stub = syscall_get_sysenter_stub();
+
+    barrier();
+    s_ready = true;
+
+    klog_info(KLOG_VDATA, "page at %p (user %p), tick %u ns\n", vdata,
+        VDATA_ADDR, vdata->tick_ns);
+
+    return 0;
+}
+
+void vdata_tick(void)
+{
+    struct vdata *vdata = page();
+    u64 tsc = rdtsc();
+
+    write_begin(vdata);
+
+    ++vdata->ticks;
+    vdata->tick_tsc = tsc;
+
+    vdata->wall_nsec += vdata->tick_ns;
+    if (vdata->wall_nsec >= 1000000000) {
+        vdata->wall_nsec -= 1000000000;
+        ++vdata->wall_sec;
+    }
+
+    if (!vdata->tsc_mult && !s_calibrate_failed) {
+        calibrate_tsc(vdata, tsc);
+    }
+
+    write_end(vdata);
+
+    if (s_calibrate_failed && vdata->ticks ==
+            VDATA_CALIBRATE_START + VDATA_CALIBRATE_TICKS) {
+        klog_warn(KLOG_VDATA, "tsc calibration failed\n");
+    }
+}
+
+u64 vdata_get_monotonic_ns(void)
+{
+    struct vdata snapshot;
+
+    if (!s_ready) {
+        return 0;
+    }
+
+    vdata_read_from(page(), &snapshot);
+    return vdata_monotonic_ns(&snapshot);
+}
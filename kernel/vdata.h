@@ -0,0 +1,25 @@
+#ifndef _INC_VDATA
+#define _INC_VDATA 1
+
+#include <kernel/vdata.h>
+
+// Kernel side of the kernel data page (see <kernel/vdata.h>).
+
+// Physical page backing VDATA_ADDR. The kernel writes to it through the
+// identity mapping; the bootloader's temporary copy of the kernel image
+// lived there and is dead by the time the kernel runs.
+#define VDATA_PHYS_ADDR     0x00008000
+
+// Clears the page and reads the wall clock. Call before the timer starts.
+// Requires syscall_init().
+int vdata_init(void);
+
+// Publishes a timer tick. Called from the PIT interrupt.
+void vdata_tick(void);
+
+// Nanoseconds since boot, for kernel timestamps. Works before paging is
+// enabled, and returns 0 before vdata_init(). Must not be called from
+// within vdata_tick().
+u64 vdata_get_monotonic_ns(void);
+
+#endif /* _INC_VDATA */
@@ -153,7 +153,7 @@ int vga_init(void)
     // Perform an inconsequential write to the DAC to normalise its state
     vga_dac_write_rgb(0xff, 0, 0, 0);
 
-    klog_printf("vga: initialised\n");
+    klog_info(KLOG_VGA, "initialised\n");
 
     return 1;
 }
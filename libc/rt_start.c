@@ -1,8 +1,18 @@
 #include <kernel/compiler.h>
+#include <kernel/syscall.h>
 
-void NO_INLINE CDECL
+// Programs take no arguments: the kernel starts each one with nothing on its
+// stack, so there is no argc or argv to pass. main()'s return value becomes
+// the exit status.
+int main(void);
+
+// Program entry point. Placed first in the image by user/user.ld, so that
+// the loader can enter at the first byte.
+void NO_INLINE CDECL SECTION(".text.start")
 _start(void) {
-    // TODO: Call main with argc and argv, then exit (via syscall?), whilst
-    // setting error status.
-    return;
+    int status = main();
+
+    __syscall2(SYS_EXIT, (u32) status);
+    for (;;) {
+    }
 }
@@ -0,0 +1,63 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <kernel/fpu.h>
+
+// Below this size the cost of entering a kernel FPU section outweighs the
+// gain from 16-byte moves.
+#define SSE2_COPY_THRESHOLD 512
+
+void *
+memcpy_sse2(void *dest, const void *src, size_t len)
+{
+    unsigned char       *dest8  = (unsigned char *) dest;
+    const unsigned char *src8   = (const unsigned char *) src;
+    size_t              head;
+    size_t              blocks;
+
+    if (len < SSE2_COPY_THRESHOLD || !dest || !src || !kernel_fpu_usable()) {
+        return memcpy(dest, src, len);
+    }
+
+    // Copy up to the first 16-byte boundary of dest, so that the stores are
+    // aligned. Loads may still be unaligned.
+    head = (16 - ((uintptr_t) dest8 & 15)) & 15;
+    memcpy(dest8, src8, head);
+    dest8 += head;
+    src8  += head;
+    len   -= head;
+
+    blocks = len / 64;
+
+    kernel_fpu_begin();
+
+    // libc is built without SSE code generation, so the compiler never keeps
+    // anything in XMM registers and they need not be listed as clobbers.
+    __asm__ volatile (
+        "1:                         \n\t"
+        "movdqu xmm0, [%1]          \n\t"
+        "movdqu xmm1, [%1 + 16]     \n\t"
+        "movdqu xmm2, [%1 + 32]     \n\t"
+        "movdqu xmm3, [%1 + 48]     \n\t"
+        "movdqa [%0], xmm0          \n\t"
+        "movdqa [%0 + 16], xmm1     \n\t"
+        "movdqa [%0 + 32], xmm2     \n\t"
+        "movdqa [%0 + 48], xmm3     \n\t"
+        "add    %1, 64              \n\t"
+        "add    %0, 64              \n\t"
+        "dec    %2                  \n\t"
+        "jnz    1b                  \n\t":
+        "+r"(dest8),
+        "+r"(src8),
+        "+r"(blocks)::
+        "cc",
+        "memory"
+    );
+
+    kernel_fpu_end();
+
+    // Remaining tail
+    memcpy(dest8, src8, len % 64);
+
+    return dest;
+}
@@ -0,0 +1,33 @@
+#include <string.h>
+#include <stdint.h>
+
+void *
+memset(void *ptr, int value, size_t len)
+{
+    if (len == 0 || !ptr) {
+        goto done;
+    }
+
+    // If word-aligned, word-wise fill
+    if (((uintptr_t) ptr % sizeof(unsigned int) == 0) &&
+        (len % sizeof(unsigned int) == 0)) {
+
+        register unsigned int       *ptr32  = (unsigned int *) ptr;
+        register const size_t       len32   = len / sizeof(unsigned int);
+        register const unsigned int val32   = 0x01010101u * (unsigned char) value;
+
+        for (register size_t i = 0; i < len32; ++i) {
+            ptr32[i] = val32;
+        }
+    // Otherwise, byte-wise fill
+    } else {
+        register unsigned char *ptr8 = (unsigned char *) ptr;
+
+        for (register size_t i = 0; i < len; ++i) {
+            ptr8[i] = (unsigned char) value;
+        }
+    }
+
+done:
+    return ptr;
+}
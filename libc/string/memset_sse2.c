@@ -0,0 +1,58 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <kernel/fpu.h>
+
+// Below this size the cost of entering a kernel FPU section outweighs the
+// gain from 16-byte stores.
+#define SSE2_SET_THRESHOLD 512
+
+void *
+memset_sse2(void *ptr, int value, size_t len)
+{
+    unsigned char   *ptr8 = (unsigned char *) ptr;
+    unsigned int    val32 = 0x01010101u * (unsigned char) value;
+    size_t          head;
+    size_t          blocks;
+
+    if (len < SSE2_SET_THRESHOLD || !ptr || !kernel_fpu_usable()) {
+        return memset(ptr, value, len);
+    }
+
+    // Fill up to the first 16-byte boundary, so that the stores are aligned.
+    head = (16 - ((uintptr_t) ptr8 & 15)) & 15;
+    memset(ptr8, value, head);
+    ptr8 += head;
+    len  -= head;
+
+    blocks = len / 64;
+
+    kernel_fpu_begin();
+
+    // libc is built without SSE code generation, so the compiler never keeps
+    // anything in XMM registers and they need not be listed as clobbers.
+    __asm__ volatile (
+        "movd   xmm0, %2            \n\t"
+        "pshufd xmm0, xmm0, 0       \n\t"
+        "1:                         \n\t"
+        "movdqa [%0], xmm0          \n\t"
+        "movdqa [%0 + 16], xmm0     \n\t"
+        "movdqa [%0 + 32], xmm0     \n\t"
+        "movdqa [%0 + 48], xmm0     \n\t"
+        "add    %0, 64              \n\t"
+        "dec    %1                  \n\t"
+        "jnz    1b                  \n\t":
+        "+r"(ptr8),
+        "+r"(blocks):
+        "r"(val32):
+        "cc",
+        "memory"
+    );
+
+    kernel_fpu_end();
+
+    // Remaining tail
+    memset(ptr8, value, len % 64);
+
+    return ptr;
+}
@@ -0,0 +1,27 @@
+#include <time.h>
+
+#include <kernel/vdata.h>
+
+// Both read the kernel data page, so neither enters the kernel.
+
+clock_t clock(void)
+{
+    struct vdata snapshot;
+
+    vdata_read(&snapshot);
+    return (clock_t) vdata_monotonic_ns(&snapshot);
+}
+
+time_t time(time_t *timer)
+{
+    struct vdata snapshot;
+    time_t now;
+
+    vdata_read(&snapshot);
+    now = (time_t) snapshot.wall_sec;
+
+    if (timer) {
+        *timer = now;
+    }
+    return now;
+}
@@ -0,0 +1,315 @@
+// Host-side conformance tests for the kernel's formatter (kernel/kio.c).
+//
+// Each case is formatted by ksnprintf() and by the host's snprintf(), and
+// the two must agree on both the text and the return value. Every case is
+// run three times: from a .rodata format on first use, from the same format
+// again, out of the format cache, and from a copy on the stack, which is
+// never cached. The few conversions where kio deliberately differs from C
+// have their expected output spelled out instead.
+//
+// Build and run with 'make test' from the top of the tree.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "kio.h"
+#include "con.h"
+#include "serial.h"
+
+#define TEXT_SIZE   256
+
+static int s_cases;
+static int s_failures;
+
+// kio's console, serial and log hooks; the tests only format into buffers
+void klog_flush(void)
+{
+}
+
+static void con_sink_put(struct kio_sink *sink, const char *str, size_t len)
+{
+    (void) sink;
+    fwrite(str, 1, len, stdout);
+}
+
+static void serial_sink_put(struct kio_sink *sink, const char *str, size_t len)
+{
+    (void) sink;
+    (void) str;
+    (void) len;
+}
+
+struct kio_sink con_sink = { con_sink_put };
+struct kio_sink serial_sink = { serial_sink_put };
+
+static void fail(int line, const char *fmt, const char *how, const char *got,
+    const char *want)
+{
+    ++s_failures;
+    printf("kio_test.c:%d: \"%s\" (%s): got \"%s\", want \"%s\"\n", line, fmt,
+        how, got, want);
+}
+
+// Compares kio against the host, with an output buffer of 'size' bytes
+static void vcheck_sized(int line, size_t size, const char *fmt, va_list args)
+{
+    static const char *const runs[] = { "first", "cached", "stack" };
+    char want[TEXT_SIZE];
+    char got[TEXT_SIZE];
+    char fmt_copy[TEXT_SIZE];
+    int want_len;
+
+    va_list ap;
+
+    va_copy(ap, args);
+    want_len = vsnprintf(want, size, fmt, ap);
+    va_end(ap);
+
+    strcpy(fmt_copy, fmt);
+
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+        int got_len;
+
+        ++s_cases;
+
+        // Canary, so a missing terminator shows up
+        memset(got, 'X', sizeof(got));
+        got[sizeof(got) - 1] = '\0';
+
+        va_copy(ap, args);
+        got_len = kvsnprintf(got, size, i == 2 ? fmt_copy : fmt, ap);
+        va_end(ap);
+
+        if (size && strcmp(got, want)) {
+            fail(line, fmt, runs[i], got, want);
+        } else if (got_len != want_len) {
+            char got_num[16];
+            char want_num[16];
+
+            snprintf(got_num, sizeof(got_num), "%d", got_len);
+            snprintf(want_num, sizeof(want_num), "%d", want_len);
+            fail(line, fmt, "return value", got_num, want_num);
+        }
+    }
+}
+
+__attribute__((format(printf, 2, 3)))
+static void check(int line, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vcheck_sized(line, TEXT_SIZE, fmt, args);
+    va_end(args);
+}
+
+__attribute__((format(printf, 3, 4)))
+static void check_sized(int line, size_t size, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vcheck_sized(line, size, fmt, args);
+    va_end(args);
+}
+
+// For output that isn't meant to match the host's
+static void check_as(int line, const char *want, const char *fmt, ...)
+{
+    char got[TEXT_SIZE];
+    va_list args;
+
+    ++s_cases;
+
+    va_start(args, fmt);
+    kvsnprintf(got, sizeof(got), fmt, args);
+    va_end(args);
+
+    if (strcmp(got, want)) {
+        fail(line, fmt, "kio", got, want);
+    }
+}
+
+#define CHECK(...)          check(__LINE__, __VA_ARGS__)
+#define CHECK_SIZED(...)    check_sized(__LINE__, __VA_ARGS__)
+#define CHECK_AS(...)       check_as(__LINE__, __VA_ARGS__)
+
+static void test_integers(void)
+{
+    CHECK("%d %i %d %d", 0, 42, -17, -2147483647 - 1);
+    CHECK("%u %u", 3000000000u, 7u);
+    CHECK("%x %X %o", 0xdeadbeefu, 0xabcu, 8u);
+    CHECK("%llu %lld %llx", 18446744073709551615ull,
+        -9223372036854775807ll - 1, 0x123456789abcdefull);
+    CHECK("%llu %llu %llu", 1000000000ull, 4294967296ull,
+        10000000000000000000ull);
+    CHECK("%ld %lu %lx", -123456789l, 123456789ul, 0xcafeul);
+    CHECK("%zu %zx %td", (size_t) 12, (size_t) 0xff, (ptrdiff_t) -5);
+    CHECK("%jd %ju", (intmax_t) -1, (uintmax_t) 99);
+
+    // 'hh' and 'h' cut the promoted int back down
+    CHECK("%hhx %hhu %hhd %hhd", 0x1ff, 0x1ff, 0x80, 0x7f);
+    CHECK("%hd %hu %hx %hd", 70000, 70000, 0x12345, -1);
+}
+
+// Some cases pass flags that C says to ignore, on purpose
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+
+static void test_flags(void)
+{
+    CHECK("%5d|%-5d|%05d|%-05d", 42, 42, -42, -42);
+    CHECK("%+d %+d % d % d %+ d", 42, -42, 42, -42, 42);
+    CHECK("%+u % u %+x", 42u, 42u, 42u);
+    CHECK("%#x %#X %#o %#x %#o", 0x1fu, 0xabu, 8u, 0u, 0u);
+    CHECK("%#04x %#04X %#06x %#2x", 5u, 10u, 0xabu, 0x20u);
+    CHECK("%08x %-8x| %8x", 0x1234u, 0x1234u, 0x1234u);
+    CHECK("%#010x %#-10x|", 0xbeefu, 0xbeefu);
+    CHECK("%+05d % 05d %+-6d|", 7, 7, 7);
+}
+
+static void test_precision(void)
+{
+    CHECK("%.5d|%7.5d|%-7.5d|", 42, 42, 42);
+    CHECK("%05.2d|%.5d|%+.3d", 42, -42, 7);
+    CHECK("|%3.0d|%.0x|%.0u|%d|", 0, 0u, 0u, 0);
+    CHECK("%.d %.d", 7, 0);
+    CHECK("%#.6x %#.3o %#.0o %#5.0x|", 255u, 8u, 0u, 0u);
+    CHECK("%.10llu %.3lld", 42ull, -7ll);
+}
+
+#pragma GCC diagnostic pop
+
+static void test_strings(void)
+{
+    CHECK("%s %c %%", "str", 'c');
+    CHECK("%.3s|%5.2s|%-5.2s|%.0s|", "abcdef", "abcdef", "abcdef", "abc");
+    CHECK("%5s|%-5s|%1s|", "str", "str", "str");
+    CHECK("%5c|%-5c|%c", 'c', 'c', 'c');
+    CHECK("%.10s|", "short");
+
+    // Precision bounds the read, so the string needn't be terminated
+    static const char unterminated[3] = { 'a', 'b', 'c' };
+    CHECK("%.3s|", unterminated);
+}
+
+static void test_star(void)
+{
+    CHECK("%*d|%*d|%*.*d|", 5, 42, -5, 42, 5, 3, 42);
+    CHECK("%.*d|%.*s|%-*s|", -1, 42, 2, "abcdef", 4, "ab");
+    CHECK("%*s|%*c|", 6, "ab", -3, 'z');
+}
+
+static void test_literals(void)
+{
+    CHECK("%s", "");
+    CHECK("plain text, no conversions");
+    CHECK("a%db%sc%%d%4xe", 2, "S", 0xffu);
+    CHECK("%d.%d", 1, 5);
+
+    // More conversions than a format cache entry holds
+    CHECK("%d%d%d%d%d%d%d%d%d%d", 0, 1, 2, 3, 4, 5, 6, 7, 8, 9);
+    CHECK("eax=%08x ebx=%08x ecx=%08x edx=%08x esi=%08x edi=%08x ebp=%08x "
+        "esp=%08x efl=%08x", 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u, 9u);
+}
+
+static void test_truncation(void)
+{
+    CHECK_SIZED(4, "%s-%d", "hello", 42);
+    CHECK_SIZED(6, "%8d", 1234567);
+    CHECK_SIZED(6, "%-8d|", 12);
+    CHECK_SIZED(6, "abcdefgh%d", 1);
+    CHECK_SIZED(1, "abc");
+    CHECK_SIZED(0, "%d", 12345);
+    CHECK_SIZED(16, "%300d", 1);
+}
+
+// kio's own conventions
+static void test_kio_specific(void)
+{
+    char want[TEXT_SIZE];
+
+    // Pointers always show every digit
+    snprintf(want, sizeof(want), "0x%0*llx|", (int) sizeof(void *) * 2,
+        0x1000ull);
+    CHECK_AS(want, "%p|", (void *) 0x1000);
+
+    CHECK_AS("(null)", "%s", (const char *) NULL);
+    CHECK_AS("trail <invalid>", "trail %");
+    CHECK_AS("dot <invalid>", "dot %.");
+    CHECK_AS("<unsupported>", "%f", 1.0);
+}
+
+// Formats are parsed once, however many conversions they have
+static void test_cache(void)
+{
+    static const char fmt[] = "%d%d%d%d%d%d%d%d%d%d%d%d";
+    char text[TEXT_SIZE];
+    u32 hits[2];
+    u32 misses[2];
+
+    ++s_cases;
+
+    kio_get_fmtcache_stats(&hits[0], &misses[0]);
+    for (int i = 0; i < 4; ++i) {
+        ksnprintf(text, sizeof(text), fmt, i, i, i, i, i, i, i, i, i, i, i, i);
+    }
+    kio_get_fmtcache_stats(&hits[1], &misses[1]);
+
+    if (misses[1] - misses[0] != 1 || hits[1] - hits[0] != 3) {
+        ++s_failures;
+        printf("kio_test.c:%d: cache: %u misses, %u hits, want 1 and 3\n",
+            __LINE__, misses[1] - misses[0], hits[1] - hits[0]);
+    }
+}
+
+// Counts what a sink is handed, to check output is streamed
+struct count_sink {
+    struct kio_sink sink;
+    size_t          calls;
+    size_t          total;
+};
+
+static void count_sink_put(struct kio_sink *sink, const char *str, size_t len)
+{
+    struct count_sink *cs = (struct count_sink *) sink;
+
+    (void) str;
+    ++cs->calls;
+    cs->total += len;
+}
+
+static void test_sink(void)
+{
+    struct count_sink cs = { { count_sink_put }, 0, 0 };
+    int len = kfprintf(&cs.sink, "%5000d|%s", 1, "abc");
+
+    ++s_cases;
+
+    if (len != 5004 || cs.total != 5004 || cs.calls < 2) {
+        ++s_failures;
+        printf("kio_test.c:%d: sink: len %d, total %zu in %zu calls\n",
+            __LINE__, len, cs.total, cs.calls);
+    }
+}
+
+int main(void)
+{
+    test_integers();
+    test_flags();
+    test_precision();
+    test_strings();
+    test_star();
+    test_literals();
+    test_truncation();
+    test_kio_specific();
+    test_cache();
+    test_sink();
+
+    printf("kio_test: %d cases, %d failed\n", s_cases, s_failures);
+
+    return s_failures ? 1 : 0;
+}
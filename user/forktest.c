@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include <kernel/syscall.h>
+
+#define CHILDREN 3
+
+// The parent fills in every page before forking, so the children share them
+// copy-on-write. Each child then writes its own page, so only that page gets
+// copied.
+static char s_pages[CHILDREN][PAGE_SIZE] PAGE_ALIGNED;
+
+static void print(const char *s)
+{
+    syscall_fast4(SYS_WRITE, (u32) s, strlen(s), 0);
+}
+
+static void print_int(int value)
+{
+    char buffer[12];
+    char *p = buffer + sizeof(buffer) - 1;
+    bool negative = value < 0;
+
+    *p = '\0';
+    do {
+        *--p = (char) ('0' + (negative ? -(value % 10) : value % 10));
+        value /= 10;
+    } while (value);
+
+    if (negative) {
+        *--p = '-';
+    }
+    print(p);
+}
+
+int main(void)
+{
+    int pids[CHILDREN];
+
+    memset(s_pages, 0xff, sizeof(s_pages));
+
+    for (int i = 0; i < CHILDREN; ++i) {
+        int pid = (int) syscall_fast4(SYS_FORK, 0, 0, 0);
+
+        if (pid < 0) {
+            print("forktest: fork failed\n");
+            return 1;
+        }
+
+        if (!pid) {
+            s_pages[i][0] = (char) i;
+
+            // The last child becomes a different program altogether
+            if (i == CHILDREN - 1) {
+                syscall_fast4(SYS_EXEC, (u32) "hello", 5, 0);
+                print("forktest: exec failed\n");
+            }
+            return s_pages[i][0];
+        }
+
+        pids[i] = pid;
+    }
+
+    for (int i = 0; i < CHILDREN; ++i) {
+        int code = -1;
+
+        syscall_fast4(SYS_WAIT, (u32) pids[i], (u32) &code, 0);
+        print("forktest: pid ");
+        print_int(pids[i]);
+        print(" exited with ");
+        print_int(code);
+        print("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include <string.h>
+
+#include <kernel/syscall.h>
+
+static void print(const char *s)
+{
+    syscall_fast4(SYS_WRITE, (u32) s, strlen(s), 0);
+}
+
+int main(void)
+{
+    print("Hello from ring 3!\n");
+    return (int) syscall_fast4(SYS_GETPID, 0, 0, 0);
+}
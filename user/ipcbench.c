@@ -0,0 +1,178 @@
+#include <string.h>
+
+#include <kernel/ipc.h>
+#include <kernel/syscall.h>
+#include <kernel/uring.h>
+#include <kernel/asm/misc.h>
+
+#define PING_CALLS      1000
+#define BULK_CALLS      100
+#define BULK_PAGES      IPC_MAX_GRANT_PAGES
+#define BULK_SIZE       (BULK_PAGES * PAGE_SIZE)
+#define RING_ENTRIES    8
+
+// Where the server takes granted pages; outside the program's own regions
+#define SERVER_WINDOW   0x80000000
+
+// Tells the server to stop
+#define WORD_QUIT       0xdead
+
+static u8 s_bulk[BULK_SIZE] PAGE_ALIGNED;
+static u8 s_copy[BULK_SIZE] PAGE_ALIGNED;
+static u8 s_ring[PAGE_SIZE] PAGE_ALIGNED;
+
+static void print(const char *s)
+{
+    syscall_fast4(SYS_WRITE, (u32) s, strlen(s), 0);
+}
+
+static void print_uint(u32 value)
+{
+    char buffer[12];
+    char *p = buffer + sizeof(buffer) - 1;
+
+    *p = '\0';
+    do {
+        *--p = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    print(p);
+}
+
+static void print_result(const char *what, u32 cycles, u32 count)
+{
+    print("  ");
+    print(what);
+    print(": ");
+    print_uint(cycles / count);
+    print(" cycles\n");
+}
+
+// Echoes every call, handing granted pages straight back
+static int serve(int id)
+{
+    struct ipc_message msg;
+
+    for (;;) {
+        if ((s32) syscall_fast4(SYS_IPC_RECV, (u32) id, (u32) &msg,
+                SERVER_WINDOW)) {
+            return 1;
+        }
+
+        if (msg.word == WORD_QUIT) {
+            syscall_fast4(SYS_IPC_REPLY, (u32) id, 0, 0);
+            return 0;
+        }
+
+        // Look at the payload, as a real server would
+        if (msg.pages) {
+            msg.word += *(volatile u32 *) SERVER_WINDOW;
+        }
+
+        syscall_fast4(SYS_IPC_REPLY, (u32) id, msg.word,
+            msg.pages ? IPC_GRANT(SERVER_WINDOW, msg.pages) : 0);
+    }
+}
+
+static u32 bench_ping(int id)
+{
+    u64 start = rdtsc();
+
+    for (u32 i = 0; i < PING_CALLS; ++i) {
+        syscall_fast4(SYS_IPC_CALL, (u32) id, i, 0);
+    }
+
+    return (u32) (rdtsc() - start);
+}
+
+static u32 bench_bulk_grant(int id)
+{
+    u64 start = rdtsc();
+
+    for (u32 i = 0; i < BULK_CALLS; ++i) {
+        s_bulk[0] = (u8) i;
+        syscall_fast4(SYS_IPC_CALL, (u32) id, i,
+            IPC_GRANT(s_bulk, BULK_PAGES));
+    }
+
+    return (u32) (rdtsc() - start);
+}
+
+// What a copying transport would add per message: a copy in and a copy out
+static u32 bench_bulk_copy(void)
+{
+    u64 start = rdtsc();
+
+    for (u32 i = 0; i < BULK_CALLS; ++i) {
+        memcpy(s_copy, s_bulk, BULK_SIZE);
+        memcpy(s_bulk, s_copy, BULK_SIZE);
+    }
+
+    return (u32) (rdtsc() - start);
+}
+
+// Pages behind a registered ring must not be granted away
+static int check_ring_grant(int id)
+{
+    int ring = (int) syscall_fast4(SYS_URING_SETUP, (u32) s_ring,
+        RING_ENTRIES, 0);
+    s32 result;
+
+    if (ring < 0) {
+        print("ipcbench: no ring\n");
+        return 1;
+    }
+
+    result = (s32) syscall_fast4(SYS_IPC_CALL, (u32) id, 0,
+        IPC_GRANT(s_ring, 1));
+    syscall_fast4(SYS_URING_DESTROY, (u32) ring, 0, 0);
+
+    if (result >= 0) {
+        print("ipcbench: granted a registered ring\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int id = (int) syscall_fast4(SYS_IPC_CREATE, 0, 0, 0);
+    int server;
+
+    if (id < 0) {
+        print("ipcbench: no endpoint\n");
+        return 1;
+    }
+
+    // The child calls; the parent owns the endpoint and serves
+    server = (int) syscall_fast4(SYS_FORK, 0, 0, 0);
+    if (server < 0) {
+        print("ipcbench: fork failed\n");
+        return 1;
+    }
+    if (server) {
+        return serve(id);
+    }
+
+    // Touch the buffers, so that page-ins aren't measured
+    memset(s_bulk, 1, BULK_SIZE);
+    memset(s_copy, 1, BULK_SIZE);
+
+    if (check_ring_grant(id)) {
+        syscall_fast4(SYS_IPC_CALL, (u32) id, WORD_QUIT, 0);
+        return 1;
+    }
+
+    print("  ping-pong, per round trip\n");
+    print_result("call/reply", bench_ping(id), PING_CALLS);
+
+    print("  ");
+    print_uint(BULK_SIZE);
+    print(" bytes, per round trip\n");
+    print_result("page grant", bench_bulk_grant(id), BULK_CALLS);
+    print_result("2x memcpy", bench_bulk_copy(), BULK_CALLS);
+
+    syscall_fast4(SYS_IPC_CALL, (u32) id, WORD_QUIT, 0);
+    return 0;
+}